@@ -30,6 +30,15 @@
  *
  * With full logging:
  *   BOX64_DYNAREC=1 BOX64_DYNAREC_LOG=3 box64 ./001_fork_in_used_leak
+ *
+ * With patches/001_dynarec_stats_json.patch applied to box64, checks the
+ * real counters instead of only printing the expected ones; each child
+ * exits 1 if it inherited stale in_used:
+ *   BOX64_DYNAREC_STATS=/tmp/box64_stats.%p.json box64 ./001_fork_in_used_leak
+ *
+ * With patches/box64ctl_wrapped_lib.patch on top, the child asks box64
+ * directly (common/box64ctl.h), no environment variable needed, and also
+ * checks that box64_purge() can invalidate the inherited blocks.
  */
 
 #define _GNU_SOURCE
@@ -43,6 +52,9 @@
 #include <stdatomic.h>
 #include <time.h>
 
+#include "../common/box64_stats.h"
+#include "../common/box64ctl.h"
+
 /* Configuration */
 #define NUM_WORKERS       8    /* Number of worker threads */
 #define NUM_HOT_FUNCS     4    /* Number of different hot functions */
@@ -187,7 +199,93 @@ void print_expected_state(const char* context) {
     printf("  +-----------------+------------------+\n");
 }
 
-void child_verify_stale_blocks(int fork_num) {
+/*
+ * Read the child's real counters from box64 (BOX64_DYNAREC_STATS).
+ * The calling thread itself holds the block(s) it is running in, so only
+ * a sum of at least NUM_WORKERS means the workers' counts leaked in.
+ * Returns 1 if stale in_used was found (or no stats could be read).
+ */
+int check_box64_stats(void) {
+    char* json = box64_stats_snapshot();
+    if (!json) {
+        printf("\n[Stats] No stats from box64 within %d ms (unpatched box64?)\n",
+               BOX64_STATS_TIMEOUT_MS);
+        return 1;
+    }
+
+    long sum = box64_stats_get(json, "in_used_sum");
+    printf("\n[Stats] Actual in_used state in child (from box64):\n");
+    printf("  +-----------------+------------------+\n");
+    printf("  | total_blocks    | %16ld |\n", box64_stats_get(json, "total_blocks"));
+    printf("  | in_used_blocks  | %16ld |\n", box64_stats_get(json, "in_used_blocks"));
+    printf("  | in_used_sum     | %16ld |\n", sum);
+    printf("  | in_used_max     | %16ld |\n", box64_stats_get(json, "in_used_max"));
+    printf("  | pinned_blocks   | %16ld |\n", box64_stats_get(json, "pinned_blocks"));
+    printf("  +-----------------+------------------+\n");
+    free(json);
+
+    if (sum >= NUM_WORKERS) {
+        printf("  FAIL: in_used_sum %ld >= %d workers, counters are stale\n",
+               sum, NUM_WORKERS);
+        return 1;
+    }
+    printf("  PASS: in_used_sum %ld < %d workers, no stale counters\n",
+           sum, NUM_WORKERS);
+    return 0;
+}
+
+/*
+ * Same check through libbox64ctl.so: read the counters, purge every block
+ * nobody runs, and read them again. Stale in_used survives the purge,
+ * since a pinned block is never invalidated.
+ * Returns 1 if stale in_used was found.
+ */
+int check_box64ctl(void) {
+    box64ctl_stats_t before, after;
+    box64ctl_block_t b;
+
+    box64ctl_stats(&before);
+    printf("\n[box64ctl] Entry block of each hot function (from box64):\n");
+    printf("  +-----------------+----------+-------------+---------+\n");
+    printf("  | Function        | x86 size | native size | in_used |\n");
+    printf("  +-----------------+----------+-------------+---------+\n");
+    for (int i = 0; i < NUM_HOT_FUNCS; i++) {
+        if (box64ctl_block_info((const void *)hot_functions[i], &b) == 0)
+            printf("  | %-15s | %8llu | %11llu | %7lld |\n", hot_func_names[i],
+                   (unsigned long long)b.x64_size,
+                   (unsigned long long)b.native_size, (long long)b.in_used);
+        else
+            printf("  | %-15s | %8s | %11s | %7s |\n", hot_func_names[i],
+                   "-", "-", "-");
+    }
+    printf("  +-----------------+----------+-------------+---------+\n");
+
+    int purged = box64ctl_purge();
+    box64ctl_stats(&after);
+
+    printf("\n[box64ctl] Counters around box64_purge() (%d invalidated):\n", purged);
+    printf("  +-----------------+------------+------------+\n");
+    printf("  | Counter         |     before |      after |\n");
+    printf("  +-----------------+------------+------------+\n");
+    printf("  | done_blocks     | %10llu | %10llu |\n",
+           (unsigned long long)before.done_blocks, (unsigned long long)after.done_blocks);
+    printf("  | pinned_blocks   | %10llu | %10llu |\n",
+           (unsigned long long)before.pinned_blocks, (unsigned long long)after.pinned_blocks);
+    printf("  | in_used_sum     | %10llu | %10llu |\n",
+           (unsigned long long)before.in_used_sum, (unsigned long long)after.in_used_sum);
+    printf("  +-----------------+------------+------------+\n");
+
+    if (after.in_used_sum >= NUM_WORKERS) {
+        printf("  FAIL: in_used_sum %llu >= %d workers after purge, counters are stale\n",
+               (unsigned long long)after.in_used_sum, NUM_WORKERS);
+        return 1;
+    }
+    printf("  PASS: in_used_sum %llu < %d workers, no stale counters\n",
+           (unsigned long long)after.in_used_sum, NUM_WORKERS);
+    return 0;
+}
+
+int child_verify_stale_blocks(int fork_num) {
     printf("\n");
     print_separator();
     printf(" CHILD PROCESS (PID %d) - Fork #%d\n", getpid(), fork_num);
@@ -200,7 +298,8 @@ void child_verify_stale_blocks(int fork_num) {
     printf("  - Child has 0 worker threads\n");
     printf("  - All inherited in_used counters are STALE!\n");
 
-    print_expected_state("in child (all stale)");
+    if (!box64_stats_enabled() && !box64ctl_available())
+        print_expected_state("in child (all stale)");
 
     printf("\n[Child] Attempting to use each dynarec block...\n\n");
 
@@ -218,6 +317,11 @@ void child_verify_stale_blocks(int fork_num) {
         printf("\n");
     }
 
+    if (box64ctl_available())
+        return check_box64ctl();
+    if (box64_stats_enabled())
+        return check_box64_stats();
+
     printf("Conclusion:\n");
     printf("  - All %d blocks STILL have stale in_used > 0\n", NUM_HOT_FUNCS);
     printf("  - PurgeDynarecMap() will SKIP all these blocks\n");
@@ -234,6 +338,7 @@ void child_verify_stale_blocks(int fork_num) {
         }
     }
     printf("[Child] Even with memory pressure, stale blocks cannot be purged.\n");
+    return 0;
 }
 
 int run_single_fork_test(void) {
@@ -275,6 +380,7 @@ int run_single_fork_test(void) {
     printf("\n[Main] All %d workers are INSIDE their dynarec blocks\n", NUM_WORKERS);
     printf("[Main] Calling fork() now...\n");
     printf("\n");
+    fflush(stdout);   /* don't duplicate buffered output into the child */
 
     pid_t pid = fork();
 
@@ -289,12 +395,13 @@ int run_single_fork_test(void) {
 
     if (pid == 0) {
         /* CHILD PROCESS */
-        child_verify_stale_blocks(1);
+        int stale = child_verify_stale_blocks(1);
 
         print_separator();
         printf(" CHILD EXIT\n");
         print_separator();
-        _exit(0);
+        fflush(stdout);
+        _exit(stale);
     }
 
     /* PARENT PROCESS */
@@ -312,7 +419,8 @@ int run_single_fork_test(void) {
         pthread_join(workers[i], NULL);
     }
 
-    return 0;
+    /* Non-zero only when the child checked real box64 stats and failed */
+    return WEXITSTATUS(status);
 }
 
 int run_stress_test(void) {
@@ -360,6 +468,7 @@ int run_stress_test(void) {
     for (int f = 0; f < STRESS_FORKS; f++) {
         printf("[Main] === Fork %d/%d ===\n", f + 1, STRESS_FORKS);
 
+        fflush(stdout);
         pid_t pid = fork();
 
         if (pid < 0) {
@@ -369,7 +478,7 @@ int run_stress_test(void) {
 
         if (pid == 0) {
             /* CHILD PROCESS */
-            child_verify_stale_blocks(f + 1);
+            int stale = child_verify_stale_blocks(f + 1);
 
             /* In stress mode, child also forks to show accumulation */
             if (f < 2) {  /* Only first 2 children fork again */
@@ -389,7 +498,8 @@ int run_stress_test(void) {
                 }
             }
 
-            _exit(0);
+            fflush(stdout);
+            _exit(stale);
         }
 
         children[fork_count++] = pid;
@@ -399,12 +509,15 @@ int run_stress_test(void) {
     }
 
     /* Wait for all children */
+    int failed_children = 0;
     printf("\n[Parent] Waiting for %d children...\n", fork_count);
     for (int i = 0; i < fork_count; i++) {
         int status;
         waitpid(children[i], &status, 0);
         printf("[Parent] Child %d (PID %d) exited: %d\n",
                i + 1, children[i], WEXITSTATUS(status));
+        if (WEXITSTATUS(status) != 0)
+            failed_children++;
     }
 
     /* Stop workers */
@@ -430,7 +543,7 @@ int run_stress_test(void) {
     printf("    - Memory leak accumulates with each fork\n");
     printf("\n");
 
-    return 0;
+    return failed_children ? 1 : 0;
 }
 
 int main(int argc, char* argv[]) {
@@ -461,6 +574,9 @@ int main(int argc, char* argv[]) {
     printf("  3. Run: BOX64_DYNAREC=1 box64 ./001_fork_in_used_leak\n");
     printf("  4. Or stress test: BOX64_DYNAREC=1 box64 ./001_fork_in_used_leak --stress\n");
     printf("  5. Look for 'Blocks with in_used > 0' in child output\n");
+    printf("  Or, with 001_dynarec_stats_json.patch, let the test check itself:\n");
+    printf("     BOX64_DYNAREC_STATS=/tmp/box64_stats.%%p.json box64 ./001_fork_in_used_leak\n");
+    printf("  Or, with box64ctl_wrapped_lib.patch on top, no variable is needed.\n");
     printf("\n");
 
     return result;
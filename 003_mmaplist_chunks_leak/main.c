@@ -32,14 +32,33 @@
  *
  *   Default: 100 dlopen/dlclose cycles.
  *   Compare "definitely lost" before and after applying the fix patch.
+ *
+ * With patches/001_dynarec_stats_json.patch applied to box64:
+ *   BOX64_DYNAREC_STATS=/tmp/box64_stats.%p.json box64 ./003_mmaplist_chunks_leak
+ *   snapshots the dynarec stats after Phase 1, after the first 10% of
+ *   cycles and at the end, and fails if Phase 1 produced no blocks or if
+ *   the global block memory keeps growing with the number of cycles.
+ *
+ * RSS (patches/dynarec_release_free_pages.patch):
+ *   ./003_mmaplist_chunks_leak [cycles] [rss_every]
+ *   prints VmRSS every rss_every cycles (default 50), then forces a purge
+ *   through box64_purge() (common/box64ctl.h), called twice since the
+ *   first call only invalidates, and prints VmRSS again.
+ *   Without the release patch, the purged blocks' pages stay resident.
  */
 
 #define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <dlfcn.h>
 
+#include "../common/box64_stats.h"
+#include "../common/box64ctl.h"
+
 #define DEFAULT_CYCLES 100
+#define DEFAULT_RSS_EVERY 50            /* Cycles between VmRSS reports */
+#define STATS_GROWTH_SLACK (64 * 1024)  /* Allowed global growth after warm-up */
 
 volatile long sink = 0;
 
@@ -107,12 +126,122 @@ static int dlopen_dlclose_cycle(const char *lib_path) {
     return 0;
 }
 
+/* ── RSS ─────────────────────────────────────────────────────────── */
+
+static long read_rss_kb(void)
+{
+    char line[256];
+    long kb = -1;
+    FILE *f = fopen("/proc/self/status", "r");
+    if (!f)
+        return -1;
+    while (fgets(line, sizeof(line), f))
+        if (strncmp(line, "VmRSS:", 6) == 0) {
+            kb = atol(line + 6);
+            break;
+        }
+    fclose(f);
+    return kb;
+}
+
+/* Phase 3: purge everything unused, report what RSS gives back */
+static void purge_and_report(long rss_phase1, int use_stats)
+{
+    printf("Phase 3: forced purge (box64_purge)...\n");
+    long before = read_rss_kb();
+    long released0 = -1;
+    if (use_stats) {
+        char *snap = box64_stats_snapshot();
+        released0 = box64_stats_get(snap, "released_bytes");
+        free(snap);
+    }
+    int purged = box64ctl_purge();
+    /* the first call invalidates, the second frees what it queued */
+    box64ctl_purge();
+    long after = read_rss_kb();
+
+    if (purged < 0) {
+        printf("  box64_purge() not available (native run or box64 without box64ctl)\n");
+        printf("  VmRSS: %ld KiB\n\n", after);
+        return;
+    }
+    printf("  Blocks purged: %d\n", purged);
+    printf("  VmRSS: %ld KiB before, %ld KiB after (%+ld), %+ld since Phase 1\n",
+           before, after, after - before, after - rss_phase1);
+    if (use_stats) {
+        char *snap = box64_stats_snapshot();
+        long released1 = box64_stats_get(snap, "released_bytes");
+        free(snap);
+        if (released0 >= 0 && released1 >= 0)
+            printf("  released_bytes: +%ld KiB by this purge\n", (released1 - released0) >> 10);
+        else
+            printf("  released_bytes: n/a (box64 without the release patch)\n");
+    }
+    printf("\n");
+}
+
+/* ── Stats check (BOX64_DYNAREC_STATS) ───────────────────────────── */
+
+static void print_stats_row(const char *key, char *snap[3]) {
+    printf("  | %-15s |", key);
+    for (int i = 0; i < 3; i++)
+        printf(" %12ld |", box64_stats_get(snap[i], key));
+    printf("\n");
+}
+
+/* Returns 1 if the snapshots show a problem, 0 otherwise */
+static int check_box64_stats(char *snap[3], int warm_cycles, int num_cycles) {
+    for (int i = 0; i < 3; i++) {
+        if (!snap[i]) {
+            printf("[Stats] No stats from box64 within %d ms (unpatched box64?)\n\n",
+                   BOX64_STATS_TIMEOUT_MS);
+            return 1;
+        }
+    }
+
+    printf("Dynarec stats, all mmaplists (from box64):\n");
+    printf("  +-----------------+--------------+--------------+--------------+\n");
+    printf("  | Field           |  after ph. 1 | %5d cycles | %5d cycles |\n",
+           warm_cycles, num_cycles);
+    printf("  +-----------------+--------------+--------------+--------------+\n");
+    print_stats_row("total_blocks", snap);
+    print_stats_row("alloc_bytes", snap);
+    print_stats_row("code_bytes", snap);
+    print_stats_row("metadata_bytes", snap);
+    print_stats_row("pinned_blocks", snap);
+    printf("  | %-15s |", "global alloc");
+    for (int i = 0; i < 3; i++)
+        printf(" %12ld |", box64_stats_get_mapping(snap[i], "global", "alloc_bytes"));
+    printf("\n");
+    printf("  +-----------------+--------------+--------------+--------------+\n");
+
+    int fail = 0;
+    if (box64_stats_get(snap[0], "total_blocks") <= 0) {
+        printf("  FAIL: no dynarec blocks after Phase 1 (is BOX64_DYNAREC=1?)\n");
+        fail = 1;
+    }
+    long growth = box64_stats_get_mapping(snap[2], "global", "alloc_bytes") -
+                  box64_stats_get_mapping(snap[1], "global", "alloc_bytes");
+    if (growth > STATS_GROWTH_SLACK) {
+        printf("  FAIL: global alloc_bytes grew by %ld after warm-up (> %d)\n",
+               growth, STATS_GROWTH_SLACK);
+        fail = 1;
+    }
+    if (!fail)
+        printf("  PASS: blocks created, global block memory flat across cycles\n");
+    printf("\n");
+    return fail;
+}
+
 int main(int argc, char *argv[]) {
     int num_cycles = DEFAULT_CYCLES;
     if (argc > 1)
         num_cycles = atoi(argv[1]);
     if (num_cycles < 1)
         num_cycles = 1;
+    int rss_every = argc > 2 ? atoi(argv[2]) : DEFAULT_RSS_EVERY;
+    if (rss_every < 1)
+        rss_every = DEFAULT_RSS_EVERY;
 
     printf("=== 003: mmaplist_t->chunks leak test ===\n\n");
 
@@ -124,7 +253,14 @@ int main(int argc, char *argv[]) {
         hot_loop_c(5000);
         hot_loop_d(5000);
     }
-    printf("  Global dynarec blocks created.\n");
+    long rss_phase1 = read_rss_kb();
+    printf("  Global dynarec blocks created. VmRSS: %ld KiB\n", rss_phase1);
+
+    int use_stats = box64_stats_enabled();
+    char *snap[3] = { NULL, NULL, NULL };
+    int warm_cycles = num_cycles / 10 > 0 ? num_cycles / 10 : 1;
+    if (use_stats)
+        snap[0] = box64_stats_snapshot();
     printf("  On exit, fini_custommem_helper will leak global chunks (~32 bytes).\n\n");
 
     /* ── Phase 2: Per-mapping leak via dlopen/dlclose ── */
@@ -141,9 +277,16 @@ int main(int argc, char *argv[]) {
         else
             fail++;
 
-        if ((i + 1) % 50 == 0)
-            printf("  ... completed %d/%d cycles\n", i + 1, num_cycles);
+        if ((i + 1) % rss_every == 0) {
+            long rss = read_rss_kb();
+            printf("  ... completed %d/%d cycles, VmRSS %ld KiB (%+ld since Phase 1)\n",
+                   i + 1, num_cycles, rss, rss - rss_phase1);
+        }
+        if (use_stats && i + 1 == warm_cycles)
+            snap[1] = box64_stats_snapshot();
     }
+    if (use_stats)
+        snap[2] = box64_stats_snapshot();
 
     printf("\n");
     printf("Results:\n");
@@ -164,7 +307,16 @@ int main(int argc, char *argv[]) {
     printf("  - Total:   ~%d bytes from chunks arrays alone\n\n",
            32 + success * 32);
 
-    printf("After fix: All chunks arrays freed, these leaks disappear.\n");
+    printf("After fix: All chunks arrays freed, these leaks disappear.\n\n");
 
-    return 0;
+    purge_and_report(rss_phase1, use_stats);
+
+    int result = 0;
+    if (use_stats) {
+        printf("\n");
+        result = check_box64_stats(snap, warm_cycles, num_cycles);
+        for (int i = 0; i < 3; i++)
+            free(snap[i]);
+    }
+    return result;
 }
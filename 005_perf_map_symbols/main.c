@@ -0,0 +1,438 @@
+/*
+ * 005_perf_map_symbols
+ *
+ * Test: dynablocks show up in perf with their x86 symbol names
+ *
+ * Background:
+ *   perf cannot symbolize samples in JIT'd code by itself: box64's
+ *   dynablocks live in anonymous mappings, so `perf report` shows them
+ *   as bare addresses. With BOX64_DYNAREC_PERFMAP=1, box64 appends one
+ *   line per compiled block to /tmp/perf-<pid>.map,
+ *
+ *     <native start, hex> <native size, hex> <name>
+ *
+ *   where the name carries the x86 symbol resolved from the ELF. perf
+ *   reads that file for the pid at report time.
+ *
+ *   The map is append-only: when a block is purged and its code cache
+ *   memory is reused for another block, both lines stay in the file and
+ *   perf may attribute samples to the stale name.
+ *
+ * What this test does:
+ *   1. runs the same four hot functions as 001 (hot_compute_0..3), each
+ *      in its own thread, long enough for the dynarec to compile them
+ *   2. reads its own /tmp/perf-<pid>.map
+ *   3. checks that each hot function has at least one entry, and reports
+ *      the entries and native bytes per function, plus overlapping ranges
+ *      that carry different names (code cache reuse after a purge)
+ *
+ *   4. when box64 answers libbox64ctl (common/box64ctl.h), purges the
+ *      code cache twice so blocks get freed
+ *   5. reads its own jit-<pid>.dump (patches/dynarec_jitdump.patch) and
+ *      checks the header, that every record is a well-formed CODE_LOAD
+ *      of this process, that each hot function has a load, and that each
+ *      "[freed] [x64 <addr>]" record covers the exact range of an earlier
+ *      load of the same x86 address
+ *
+ *   Exits 1 if the map or the dump exists but fails its check, 0 on
+ *   pass. A missing file is a SKIP for its part (native run, or
+ *   BOX64_DYNAREC_PERFMAP / BOX64_DYNAREC_JITDUMP unset).
+ *
+ * Run:
+ *   BOX64_DYNAREC=1 BOX64_DYNAREC_PERFMAP=1 box64 ./005_perf_map_symbols
+ *   BOX64_DYNAREC=1 BOX64_DYNAREC_JITDUMP=1 box64 ./005_perf_map_symbols
+ *
+ * The perf side of the same check, on 001:
+ *   BOX64_DYNAREC=1 BOX64_DYNAREC_PERFMAP=1 \
+ *       perf record -o perf.data -- box64 ./001_fork_in_used_leak
+ *   perf report -i perf.data --stdio --sort sym | grep hot_compute_
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "../common/box64ctl.h"
+
+/* Configuration */
+#define NUM_HOT_FUNCS     4    /* Same hot functions as 001 */
+#define RUN_MS            300  /* Time each hot function runs */
+#define MAX_ENTRIES       65536
+#define NAME_LEN          256
+
+/* jitdump format, tools/perf/Documentation/jitdump-specification.txt */
+#define JITDUMP_MAGIC     0x4A695444  /* "JiTD" */
+#define JITDUMP_VERSION   1
+#define JIT_CODE_LOAD     0
+#define FREED_PREFIX      "[freed] "
+
+static atomic_int stop_workers = 0;
+
+__attribute__((noinline, optimize("O2")))
+long hot_compute_0(long iterations) {
+    long sum = 0;
+    for (long i = 0; i < iterations; i++) {
+        sum += i * i;  /* Square pattern */
+        if ((i & 0x3FFFF) == 0 && atomic_load(&stop_workers)) {
+            return sum;
+        }
+    }
+    return sum;
+}
+
+__attribute__((noinline, optimize("O2")))
+long hot_compute_1(long iterations) {
+    long sum = 0;
+    for (long i = 0; i < iterations; i++) {
+        sum += i * (i + 1);  /* Different pattern */
+        if ((i & 0x3FFFF) == 0 && atomic_load(&stop_workers)) {
+            return sum;
+        }
+    }
+    return sum;
+}
+
+__attribute__((noinline, optimize("O2")))
+long hot_compute_2(long iterations) {
+    long sum = 0;
+    for (long i = 0; i < iterations; i++) {
+        sum += (i << 1) ^ i;  /* XOR pattern */
+        if ((i & 0x3FFFF) == 0 && atomic_load(&stop_workers)) {
+            return sum;
+        }
+    }
+    return sum;
+}
+
+__attribute__((noinline, optimize("O2")))
+long hot_compute_3(long iterations) {
+    long sum = 0;
+    for (long i = 0; i < iterations; i++) {
+        sum += i + (i & 0xFF);  /* Mask pattern */
+        if ((i & 0x3FFFF) == 0 && atomic_load(&stop_workers)) {
+            return sum;
+        }
+    }
+    return sum;
+}
+
+typedef long (*hot_func_t)(long);
+static hot_func_t hot_functions[NUM_HOT_FUNCS] = {
+    hot_compute_0,
+    hot_compute_1,
+    hot_compute_2,
+    hot_compute_3
+};
+
+static const char *hot_func_names[NUM_HOT_FUNCS] = {
+    "hot_compute_0",
+    "hot_compute_1",
+    "hot_compute_2",
+    "hot_compute_3"
+};
+
+typedef struct {
+    uint64_t start;
+    uint64_t size;
+    char name[NAME_LEN];
+} map_entry_t;
+
+static map_entry_t entries[MAX_ENTRIES];
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t total_size;
+    uint32_t elf_mach;
+    uint32_t pad1;
+    uint32_t pid;
+    uint64_t timestamp;
+    uint64_t flags;
+} jitdump_header_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t total_size;
+    uint64_t timestamp;
+    uint32_t pid;
+    uint32_t tid;
+    uint64_t vma;
+    uint64_t code_addr;
+    uint64_t code_size;
+    uint64_t code_index;
+    /* then the name with its NUL, then code_size bytes of code */
+} jitdump_load_t;
+
+/* One CODE_LOAD that is not a [freed] marker */
+typedef struct {
+    uint64_t code_addr;
+    uint64_t code_size;
+    const char *x64;    /* "[x64 0x...]" tag at the end of the name */
+} jit_load_t;
+
+static void *worker_func(void *arg)
+{
+    int idx = (int)(long)arg;
+    long sink = 0;
+    while (!atomic_load(&stop_workers))
+        sink += hot_functions[idx](50000000);
+    return (void *)sink;
+}
+
+static int cmp_entry(const void *a, const void *b)
+{
+    const map_entry_t *x = a, *y = b;
+    return (x->start > y->start) - (x->start < y->start);
+}
+
+/* ── Perf map parsing ────────────────────────────────────────────── */
+
+static int read_perf_map(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return -1;
+
+    char line[NAME_LEN + 64];
+    int n = 0;
+    while (n < MAX_ENTRIES && fgets(line, sizeof(line), f)) {
+        map_entry_t *e = &entries[n];
+        unsigned long long start, size;
+        int off = 0;
+        if (sscanf(line, "%llx %llx %n", &start, &size, &off) != 2 || off == 0)
+            continue;
+        e->start = start;
+        e->size = size;
+        snprintf(e->name, sizeof(e->name), "%s", line + off);
+        e->name[strcspn(e->name, "\n")] = '\0';
+        n++;
+    }
+    fclose(f);
+    return n;
+}
+
+/* ── jitdump parsing ─────────────────────────────────────────────── */
+
+static char *read_file(const char *path, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+    size_t cap = 1 << 20, n = 0;
+    char *buf = malloc(cap);
+    size_t got;
+    while (buf && (got = fread(buf + n, 1, cap - n, f)) > 0) {
+        n += got;
+        if (n == cap) {
+            char *b = realloc(buf, cap * 2);
+            if (!b) {
+                free(buf);
+                buf = NULL;
+                break;
+            }
+            buf = b;
+            cap *= 2;
+        }
+    }
+    fclose(f);
+    *size = n;
+    return buf;
+}
+
+/* Returns 1 on a malformed dump, 0 when it checks out */
+static int check_jitdump(const char *path, const char *buf, size_t size, int expect_freed)
+{
+    jitdump_header_t h;
+    if (size < sizeof(h)) {
+        printf("  FAIL: %zu bytes, shorter than the header\n", size);
+        return 1;
+    }
+    memcpy(&h, buf, sizeof(h));
+    printf("Jitdump %s: magic 0x%08x, version %u, elf_mach %u, pid %u\n\n",
+           path, h.magic, h.version, h.elf_mach, h.pid);
+    if (h.magic != JITDUMP_MAGIC || h.version != JITDUMP_VERSION ||
+        h.total_size < sizeof(h) || h.total_size > size ||
+        h.pid != (uint32_t)getpid() || h.elf_mach == 0) {
+        printf("  FAIL: bad header (want magic 0x%08x, version %d, pid %d, elf_mach set)\n",
+               JITDUMP_MAGIC, JITDUMP_VERSION, getpid());
+        return 1;
+    }
+
+    int nloads = 0, nfreed = 0, unmatched = 0, bad = 0;
+    int hot[NUM_HOT_FUNCS] = {0};
+    int cap = 1024;
+    jit_load_t *loads = malloc(cap * sizeof(*loads));
+    size_t off = h.total_size;
+    while (loads && off < size) {
+        jitdump_load_t r;
+        if (size - off < sizeof(r)) {
+            printf("  FAIL: truncated record at offset %zu\n", off);
+            bad++;
+            break;
+        }
+        memcpy(&r, buf + off, sizeof(r));
+        if (r.id != JIT_CODE_LOAD || r.total_size < sizeof(r) || r.total_size > size - off) {
+            printf("  FAIL: record at offset %zu: id %u, total_size %u\n", off, r.id, r.total_size);
+            bad++;
+            break;
+        }
+        const char *name = buf + off + sizeof(r);
+        size_t namemax = r.total_size - sizeof(r);
+        size_t namelen = strnlen(name, namemax);
+        if (namelen == namemax || sizeof(r) + namelen + 1 + r.code_size != r.total_size ||
+            r.pid != (uint32_t)getpid() || r.vma != r.code_addr || !r.code_size) {
+            printf("  FAIL: malformed CODE_LOAD at offset %zu (\"%.*s\")\n", off,
+                   (int)(namelen < 64 ? namelen : 64), name);
+            bad++;
+            break;
+        }
+        const char *x64 = strstr(name, "[x64 ");
+        if (!x64) {
+            printf("  FAIL: CODE_LOAD \"%s\" has no [x64 <addr>] tag\n", name);
+            bad++;
+        } else if (!strncmp(name, FREED_PREFIX, strlen(FREED_PREFIX))) {
+            /* must cover the range of an earlier load of the same x86 block */
+            nfreed++;
+            int found = 0;
+            for (int i = nloads - 1; i >= 0 && !found; i--)
+                found = loads[i].code_addr == r.code_addr && loads[i].code_size == r.code_size &&
+                        !strcmp(loads[i].x64, x64);
+            if (!found && unmatched++ < 4)
+                printf("  FAIL: \"%s\" at 0x%llx has no matching load\n", name,
+                       (unsigned long long)r.code_addr);
+        } else {
+            if (nloads == cap) {
+                jit_load_t *l = realloc(loads, 2 * cap * sizeof(*loads));
+                if (!l)
+                    break;
+                loads = l;
+                cap *= 2;
+            }
+            loads[nloads].code_addr = r.code_addr;
+            loads[nloads].code_size = r.code_size;
+            loads[nloads].x64 = x64;
+            nloads++;
+            for (int f = 0; f < NUM_HOT_FUNCS; f++)
+                if (!strncmp(name, hot_func_names[f], strlen(hot_func_names[f])))
+                    hot[f]++;
+        }
+        off += r.total_size;
+    }
+    free(loads);
+
+    printf("  +-----------------+------------+\n");
+    printf("  | Function        | CODE_LOADs |\n");
+    printf("  +-----------------+------------+\n");
+    for (int f = 0; f < NUM_HOT_FUNCS; f++) {
+        printf("  | %-15s | %10d |%s\n", hot_func_names[f], hot[f],
+               hot[f] ? "" : "  <-- MISSING");
+        if (!hot[f])
+            bad++;
+    }
+    printf("  +-----------------+------------+\n\n");
+    printf("CODE_LOAD records: %d, [freed] records: %d, unmatched [freed]: %d\n",
+           nloads, nfreed, unmatched);
+
+    if (expect_freed && !nfreed) {
+        printf("  FAIL: box64_purge() freed blocks but no [freed] record was written\n");
+        bad++;
+    }
+    return bad || unmatched;
+}
+
+int main(void)
+{
+    pthread_t workers[NUM_HOT_FUNCS];
+    char path[4096];
+    int failed = 0, checked = 0;
+
+    printf("########################################\n");
+    printf(" TEST 005: perf map symbols for dynablocks\n");
+    printf("########################################\n\n");
+
+    for (int i = 0; i < NUM_HOT_FUNCS; i++)
+        pthread_create(&workers[i], NULL, worker_func, (void *)(long)i);
+    usleep(RUN_MS * 1000);
+    atomic_store(&stop_workers, 1);
+    for (int i = 0; i < NUM_HOT_FUNCS; i++)
+        pthread_join(workers[i], NULL);
+
+    snprintf(path, sizeof(path), "/tmp/perf-%d.map", getpid());
+    int n = read_perf_map(path);
+    if (n < 0) {
+        printf("SKIP: no %s\n", path);
+        printf("  Run under box64 with BOX64_DYNAREC=1 BOX64_DYNAREC_PERFMAP=1.\n\n");
+    } else {
+        checked++;
+        printf("Perf map %s: %d entries\n\n", path, n);
+
+        printf("  +-----------------+---------+-------------+\n");
+        printf("  | Function        | Entries | Native size |\n");
+        printf("  +-----------------+---------+-------------+\n");
+        for (int h = 0; h < NUM_HOT_FUNCS; h++) {
+            int count = 0;
+            uint64_t bytes = 0;
+            for (int i = 0; i < n; i++) {
+                if (strstr(entries[i].name, hot_func_names[h])) {
+                    count++;
+                    bytes += entries[i].size;
+                }
+            }
+            printf("  | %-15s | %7d | %11llu |%s\n", hot_func_names[h], count,
+                   (unsigned long long)bytes, count ? "" : "  <-- MISSING");
+            if (count == 0)
+                failed |= 1;
+        }
+        printf("  +-----------------+---------+-------------+\n\n");
+
+        /* Overlapping ranges under different names: reused code cache memory */
+        qsort(entries, n, sizeof(entries[0]), cmp_entry);
+        int overlaps = 0;
+        for (int i = 1; i < n; i++)
+            if (entries[i].start < entries[i - 1].start + entries[i - 1].size &&
+                strcmp(entries[i].name, entries[i - 1].name) != 0)
+                overlaps++;
+        printf("Overlapping ranges with different names: %d%s\n\n", overlaps,
+               overlaps ? " (stale names after purge/reuse)" : "");
+    }
+
+    /* Free blocks so the dump gets [freed] records: the first purge
+     * invalidates, the second frees what it queued */
+    int purged = box64ctl_purge();
+    if (purged > 0) {
+        box64ctl_purge();
+        printf("box64_purge(): %d blocks invalidated, then freed\n\n", purged);
+    }
+
+    const char *dir = getenv("BOX64_DYNAREC_JITDUMP_DIR");
+    snprintf(path, sizeof(path), "%s/jit-%d.dump", dir && *dir ? dir : "/tmp", getpid());
+    size_t size = 0;
+    char *dump = read_file(path, &size);
+    if (!dump) {
+        printf("SKIP: no %s\n", path);
+        printf("  Run under box64 with BOX64_DYNAREC=1 BOX64_DYNAREC_JITDUMP=1\n");
+        printf("  (patches/dynarec_jitdump.patch).\n");
+    } else {
+        checked++;
+        if (check_jitdump(path, dump, size, purged > 0))
+            failed |= 2;
+        free(dump);
+    }
+
+    if (failed & 1)
+        printf("\nFAIL: hot functions missing from the perf map\n");
+    if (failed & 2)
+        printf("\nFAIL: the jitdump does not check out\n");
+    if (failed)
+        return 1;
+    if (!checked)
+        return 0;
+    printf("\nPASS: all %d hot functions are in every map box64 wrote\n", NUM_HOT_FUNCS);
+    return 0;
+}
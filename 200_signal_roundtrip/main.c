@@ -0,0 +1,250 @@
+/*
+ * 200_signal_roundtrip
+ *
+ * Benchmark: signal delivery round-trip latency
+ *
+ * Background:
+ *   Under box64 every signal is first taken by box64's native handler
+ *   (my_box64signalhandler, src/libtools/signals.c), which has to build
+ *   an x86_64 ucontext/siginfo on the emulated stack, run the emulated
+ *   handler through the emulator, then translate the (possibly modified)
+ *   context back. Runtimes that use signals for GC safepoints or sampling
+ *   profilers pay this on every signal.
+ *
+ * Scenarios:
+ *   1. raise        - raise(SIGUSR1) to self, handler counts
+ *   2. ping-pong    - two threads bounce SIGUSR1/SIGUSR2 with
+ *                     pthread_kill(), each waiting in sigsuspend()
+ *   3. segv-recover - fault on a PROT_NONE page, handler siglongjmp()s
+ *                     back to a sigsetjmp() point (002's crash-recovery
+ *                     pattern, in a loop)
+ *   4. setjmp-only  - sigsetjmp()/siglongjmp() without a signal, as the
+ *                     baseline for scenario 3
+ *
+ *   Each scenario reports round trips per second and ns per round trip.
+ *   Run under BOX64_DYNAREC=0 and BOX64_DYNAREC=1 to compare interpreter
+ *   and dynarec.
+ *
+ * Run:
+ *   ./200_signal_roundtrip [iterations]
+ *   BOX64_DYNAREC=0 box64 ./200_signal_roundtrip
+ *   BOX64_DYNAREC=1 box64 ./200_signal_roundtrip
+ *
+ *   Default: 100000 iterations per scenario.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+
+/* Configuration */
+#define DEFAULT_ITERATIONS 100000
+
+static volatile sig_atomic_t usr1_count = 0;
+static volatile sig_atomic_t usr2_count = 0;
+static volatile sig_atomic_t segv_count = 0;
+
+static sigjmp_buf recover_buf;
+static void *guard_page;
+
+static pthread_t main_thread;
+static pthread_t pong_thread;
+static long pingpong_iterations;
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void usr1_handler(int sig)
+{
+    (void)sig;
+    usr1_count++;
+}
+
+static void usr2_handler(int sig)
+{
+    (void)sig;
+    usr2_count++;
+}
+
+static void segv_handler(int sig)
+{
+    (void)sig;
+    segv_count++;
+    siglongjmp(recover_buf, 1);
+}
+
+static void install(int sig, void (*handler)(int))
+{
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigaction(sig, &sa, NULL);
+}
+
+static void print_row(const char *name, long n, uint64_t ns)
+{
+    printf("  | %-13s | %9ld | %12.0f | %10.1f |\n",
+           name, n, n * 1e9 / (double)ns, (double)ns / n);
+}
+
+/* ── Scenario 1: raise() to self ─────────────────────────────────── */
+
+static void run_raise(long n)
+{
+    usr1_count = 0;
+    uint64_t t0 = now_ns();
+    for (long i = 0; i < n; i++)
+        raise(SIGUSR1);
+    uint64_t t1 = now_ns();
+    print_row("raise", n, t1 - t0);
+    if (usr1_count != n)
+        printf("  ** WARNING: %ld raised, handler saw %d **\n", n, (int)usr1_count);
+}
+
+/* ── Scenario 2: cross-thread ping-pong ──────────────────────────── */
+
+/*
+ * Both threads keep SIGUSR1/SIGUSR2 blocked and only unblock them inside
+ * sigsuspend(), so each signal is delivered exactly where we wait for it.
+ */
+static void *pong_func(void *arg)
+{
+    (void)arg;
+    sigset_t wait_mask;
+    pthread_sigmask(SIG_BLOCK, NULL, &wait_mask);
+    sigdelset(&wait_mask, SIGUSR1);
+
+    for (long i = 0; i < pingpong_iterations; i++) {
+        while (usr1_count <= i)
+            sigsuspend(&wait_mask);
+        pthread_kill(main_thread, SIGUSR2);
+    }
+    return NULL;
+}
+
+static void run_pingpong(long n)
+{
+    sigset_t block, old, wait_mask;
+    sigemptyset(&block);
+    sigaddset(&block, SIGUSR1);
+    sigaddset(&block, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+
+    usr1_count = 0;
+    usr2_count = 0;
+    pingpong_iterations = n;
+    main_thread = pthread_self();
+    pthread_create(&pong_thread, NULL, pong_func, NULL);   /* inherits mask */
+
+    pthread_sigmask(SIG_BLOCK, NULL, &wait_mask);
+    sigdelset(&wait_mask, SIGUSR2);
+
+    uint64_t t0 = now_ns();
+    for (long i = 0; i < n; i++) {
+        pthread_kill(pong_thread, SIGUSR1);
+        while (usr2_count <= i)
+            sigsuspend(&wait_mask);
+    }
+    uint64_t t1 = now_ns();
+
+    pthread_join(pong_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    print_row("ping-pong", n, t1 - t0);
+}
+
+/* ── Scenario 3: SIGSEGV + siglongjmp recovery ───────────────────── */
+
+__attribute__((noinline))
+static void touch_guard(long i)
+{
+    *(volatile long *)guard_page = i;
+}
+
+static void run_segv_recover(long n)
+{
+    segv_count = 0;
+    uint64_t t0 = now_ns();
+    for (long i = 0; i < n; i++) {
+        if (sigsetjmp(recover_buf, 1) == 0)
+            touch_guard(i);
+    }
+    uint64_t t1 = now_ns();
+    print_row("segv-recover", n, t1 - t0);
+    if (segv_count != n)
+        printf("  ** WARNING: %ld faults, handler saw %d **\n", n, (int)segv_count);
+}
+
+/* ── Scenario 4: sigsetjmp/siglongjmp only ───────────────────────── */
+
+__attribute__((noinline))
+static void jump_back(void)
+{
+    siglongjmp(recover_buf, 1);
+}
+
+static void run_setjmp_only(long n)
+{
+    uint64_t t0 = now_ns();
+    for (long i = 0; i < n; i++) {
+        if (sigsetjmp(recover_buf, 1) == 0)
+            jump_back();
+    }
+    uint64_t t1 = now_ns();
+    print_row("setjmp-only", n, t1 - t0);
+}
+
+int main(int argc, char *argv[])
+{
+    long n = DEFAULT_ITERATIONS;
+    if (argc > 1)
+        n = atol(argv[1]);
+    if (n < 1)
+        n = 1;
+
+    printf("########################################\n");
+    printf(" BENCH 200: Signal round-trip latency\n");
+    printf(" Iterations per scenario: %ld\n", n);
+    printf("########################################\n\n");
+
+    guard_page = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (guard_page == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    install(SIGUSR1, usr1_handler);
+    install(SIGUSR2, usr2_handler);
+    install(SIGSEGV, segv_handler);
+
+    printf("  +---------------+-----------+--------------+------------+\n");
+    printf("  | Scenario      |     Trips |      Trips/s |   ns/trip  |\n");
+    printf("  +---------------+-----------+--------------+------------+\n");
+
+    run_raise(n);
+    run_pingpong(n);
+    run_segv_recover(n);
+    run_setjmp_only(n);
+
+    printf("  +---------------+-----------+--------------+------------+\n");
+    printf("\n");
+    printf("segv-recover minus setjmp-only = cost of one fault delivered to an\n");
+    printf("emulated handler. ping-pong counts one full round trip (2 signals).\n");
+
+    munmap(guard_page, sysconf(_SC_PAGESIZE));
+    return 0;
+}
@@ -0,0 +1,250 @@
+/*
+ * 201_signal_loop_latency
+ *
+ * Benchmark: pthread_kill() → handler-entry latency while the target
+ *            thread spins in pure-compute loops
+ *
+ * Background:
+ *   A thread spinning in a linked chain of dynarec blocks (like
+ *   hot_compute_0 in 001) never returns to EmuRun() and never makes a
+ *   syscall. When a signal arrives, box64's native handler interrupts
+ *   the ARM64 code in the middle of a block, where the x86 state is
+ *   partly held in host registers. Box64 then has to recover the x86
+ *   context for that point, or wait until it can, before the emulated
+ *   handler runs. That delay adds directly to GC safepoint pauses and
+ *   profiler skew.
+ *
+ * Kernels (the target thread runs one at a time):
+ *   - block_1 .. block_256: a loop whose body is N dependent ALU ops with
+ *     no branches, so the dynarec block length grows with N
+ *   - call_chain: a loop calling 8 small noinline functions in a row,
+ *     i.e. a chain of short linked blocks
+ *   - hot_compute: the hot_compute_0 loop from 001
+ *
+ * For each kernel, SAMPLES signals are sent at random intervals. The
+ * sender stamps CLOCK_MONOTONIC right before pthread_kill(); the handler
+ * stamps it on entry. The difference is the delivery latency.
+ *
+ * Run:
+ *   ./201_signal_loop_latency [samples]
+ *   BOX64_DYNAREC=1 box64 ./201_signal_loop_latency
+ *   BOX64_DYNAREC=0 box64 ./201_signal_loop_latency
+ *
+ *   Default: 2000 samples per kernel.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <time.h>
+
+/* Configuration */
+#define DEFAULT_SAMPLES   2000
+#define MIN_GAP_US        200    /* Min time between two signals */
+#define MAX_GAP_US        1000   /* Max time between two signals */
+
+static atomic_int stop_kernel = 0;
+static atomic_int target_running = 0;
+static volatile uint64_t handler_ns = 0;
+static volatile sig_atomic_t handler_hit = 0;
+static volatile long kernel_sink = 0;
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void usr1_handler(int sig)
+{
+    (void)sig;
+    handler_ns = now_ns();       /* clock_gettime is async-signal-safe */
+    handler_hit = 1;
+}
+
+/* ── Kernels ─────────────────────────────────────────────────────── */
+
+/* One dependent ALU op; the empty asm stops the compiler folding a chain */
+#define OP1(x)    do { x = x * 3 + 1; __asm__ volatile("" : "+r"(x)); } while (0)
+#define OP4(x)    OP1(x); OP1(x); OP1(x); OP1(x)
+#define OP16(x)   OP4(x); OP4(x); OP4(x); OP4(x)
+#define OP64(x)   OP16(x); OP16(x); OP16(x); OP16(x)
+#define OP256(x)  OP64(x); OP64(x); OP64(x); OP64(x)
+
+#define DEFINE_BLOCK_KERNEL(name, body)                                  \
+    __attribute__((noinline))                                            \
+    static long name(void) {                                             \
+        long x = 1;                                                      \
+        while (!atomic_load_explicit(&stop_kernel, memory_order_relaxed)) { \
+            body;                                                        \
+        }                                                                \
+        return x;                                                        \
+    }
+
+DEFINE_BLOCK_KERNEL(block_1, OP1(x))
+DEFINE_BLOCK_KERNEL(block_16, OP16(x))
+DEFINE_BLOCK_KERNEL(block_64, OP64(x))
+DEFINE_BLOCK_KERNEL(block_256, OP256(x))
+
+#define DEFINE_LINK(n)                                                   \
+    __attribute__((noinline)) static long link_##n(long x) {             \
+        OP4(x);                                                          \
+        return x + n;                                                    \
+    }
+
+DEFINE_LINK(0) DEFINE_LINK(1) DEFINE_LINK(2) DEFINE_LINK(3)
+DEFINE_LINK(4) DEFINE_LINK(5) DEFINE_LINK(6) DEFINE_LINK(7)
+
+__attribute__((noinline))
+static long call_chain(void)
+{
+    long x = 1;
+    while (!atomic_load_explicit(&stop_kernel, memory_order_relaxed)) {
+        x = link_0(x); x = link_1(x); x = link_2(x); x = link_3(x);
+        x = link_4(x); x = link_5(x); x = link_6(x); x = link_7(x);
+    }
+    return x;
+}
+
+/* Same shape as hot_compute_0 in 001_fork_in_used_leak */
+__attribute__((noinline))
+static long hot_compute(void)
+{
+    long sum = 0;
+    for (long i = 0; ; i++) {
+        sum += i * i;
+        if ((i & 0x3FFFF) == 0 && atomic_load(&stop_kernel))
+            return sum;
+    }
+}
+
+typedef long (*kernel_t)(void);
+
+static const struct {
+    const char *name;
+    kernel_t fn;
+} kernels[] = {
+    { "block_1",     block_1 },
+    { "block_16",    block_16 },
+    { "block_64",    block_64 },
+    { "block_256",   block_256 },
+    { "call_chain",  call_chain },
+    { "hot_compute", hot_compute },
+};
+
+#define NUM_KERNELS (int)(sizeof(kernels) / sizeof(kernels[0]))
+
+static void *target_func(void *arg)
+{
+    kernel_t fn = (kernel_t)arg;
+    atomic_store(&target_running, 1);
+    kernel_sink += fn();
+    return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void run_kernel(int k, int samples, uint64_t *lat)
+{
+    pthread_t target;
+    int got = 0, lost = 0;
+
+    atomic_store(&stop_kernel, 0);
+    atomic_store(&target_running, 0);
+    pthread_create(&target, NULL, target_func, (void *)kernels[k].fn);
+    while (!atomic_load(&target_running))
+        usleep(100);
+    usleep(20000);   /* let the dynarec compile the loop */
+
+    for (int s = 0; s < samples; s++) {
+        usleep(MIN_GAP_US + rand() % (MAX_GAP_US - MIN_GAP_US));
+
+        handler_hit = 0;
+        uint64_t t0 = now_ns();
+        pthread_kill(target, SIGUSR1);
+
+        /* Wait up to 1 s for the handler */
+        uint64_t deadline = t0 + 1000000000ULL;
+        while (!handler_hit && now_ns() < deadline)
+            sched_yield();
+        if (!handler_hit) {
+            lost++;
+            continue;
+        }
+        lat[got++] = handler_ns - t0;
+    }
+
+    atomic_store(&stop_kernel, 1);
+    pthread_join(target, NULL);
+
+    if (got == 0) {
+        printf("  | %-12s | %6d | %9s | %9s | %9s | %9s |\n",
+               kernels[k].name, 0, "-", "-", "-", "-");
+        return;
+    }
+    qsort(lat, got, sizeof(uint64_t), cmp_u64);
+    printf("  | %-12s | %6d | %9.1f | %9.1f | %9.1f | %9.1f |\n",
+           kernels[k].name, got,
+           lat[got / 2] / 1000.0,
+           lat[(got * 90) / 100] / 1000.0,
+           lat[(got * 99) / 100] / 1000.0,
+           lat[got - 1] / 1000.0);
+    if (lost)
+        printf("  ** WARNING: %d signals not handled within 1 s **\n", lost);
+}
+
+int main(int argc, char *argv[])
+{
+    int samples = DEFAULT_SAMPLES;
+    if (argc > 1)
+        samples = atoi(argv[1]);
+    if (samples < 1)
+        samples = 1;
+
+    uint64_t *lat = calloc(samples, sizeof(uint64_t));
+    if (!lat) {
+        perror("calloc");
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = usr1_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &sa, NULL);
+
+    srand(201);
+
+    printf("########################################\n");
+    printf(" BENCH 201: Signal latency into compute loops\n");
+    printf(" Samples per kernel: %d\n", samples);
+    printf("########################################\n\n");
+
+    printf("  pthread_kill() -> handler entry, microseconds\n");
+    printf("  +--------------+--------+-----------+-----------+-----------+-----------+\n");
+    printf("  | Kernel       | Signals|       p50 |       p90 |       p99 |       max |\n");
+    printf("  +--------------+--------+-----------+-----------+-----------+-----------+\n");
+
+    for (int k = 0; k < NUM_KERNELS; k++)
+        run_kernel(k, samples, lat);
+
+    printf("  +--------------+--------+-----------+-----------+-----------+-----------+\n");
+    printf("\n");
+    printf("Latency growing with block_N means delivery waits for the block to end.\n");
+    printf("Run on a multi-core host: on one core it also includes scheduling.\n");
+
+    free(lat);
+    return 0;
+}
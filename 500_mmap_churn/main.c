@@ -0,0 +1,266 @@
+/*
+ * 500_mmap_churn
+ *
+ * Benchmark: mmap / mprotect / munmap churn with a large number of
+ * live mappings.
+ *
+ * Background:
+ *   Box64 records every mapping it sees in the `mapallmem` rb-tree
+ *   (src/custommem.c) and every protection change in the memprot
+ *   tracking. Each x86 mmap/munmap/mprotect syscall, and every
+ *   SIGSEGV that box64 has to classify (SMC detection on protectDB'd
+ *   pages, genuine faults forwarded to the program), walks that tree.
+ *   Lookups are O(log n) in the number of distinct regions, so the
+ *   cost per operation grows with the number of live mappings.
+ *
+ * What this benchmark measures, for each mapping count N:
+ *   1. populate  - mmap N single-page regions (alternating protections
+ *                  so the kernel cannot merge them into one VMA)
+ *   2. mprotect  - toggle random pages RW <-> RO with N regions live
+ *   3. fault     - write to RO pages; the SIGSEGV handler mprotects the
+ *                  page RW and the write is retried (JIT-style pattern)
+ *   4. remap     - munmap + mmap MAP_FIXED of random pages
+ *   5. teardown  - munmap all N regions
+ *
+ *   Each phase prints ns/op. Comparing native vs box64, and box64
+ *   before/after a change to mapallmem, shows how much of the cost is
+ *   the emulator's protection tracking and how it scales with N.
+ *
+ * Notes:
+ *   - The kernel limits VMAs per process (vm.max_map_count, 65530 by
+ *     default). N above that is clamped unless the limit is raised:
+ *       sudo sysctl vm.max_map_count=2100000
+ *   - All regions are carved out of one PROT_NONE reservation so that
+ *     the pages stay adjacent (worst case for interval splitting).
+ *
+ * Run:
+ *   ./500_mmap_churn                         (N = 1000 10000 50000)
+ *   ./500_mmap_churn 1000 100000 1000000     (custom N list)
+ *   BOX64_DYNAREC=1 box64 ./500_mmap_churn
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+
+/* Configuration */
+#define DEFAULT_SIZES     { 1000, 10000, 50000 }
+#define MAX_SIZES         16
+#define MPROTECT_OPS      200000   /* Random mprotect toggles per N */
+#define FAULT_OPS         50000    /* Write faults per N */
+#define REMAP_OPS         50000    /* munmap + mmap MAP_FIXED per N */
+#define VMA_HEADROOM      2000     /* VMAs left for libc, stacks, box64 */
+
+static long page_size;
+static uint8_t *region;            /* Base of the reservation */
+static size_t region_pages;
+static volatile long fault_count = 0;
+
+/* xorshift64: cheap, deterministic page selection */
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static inline uint64_t rng_next(void)
+{
+    uint64_t x = rng_state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    rng_state = x;
+    return x;
+}
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint8_t *page_addr(size_t idx)
+{
+    return region + idx * page_size;
+}
+
+/*
+ * Even pages are RW, odd pages are RO: neighbours always differ, so
+ * every page is its own VMA and its own interval in box64's tracking.
+ */
+static inline int base_prot(size_t idx)
+{
+    return (idx & 1) ? PROT_READ : (PROT_READ | PROT_WRITE);
+}
+
+/*
+ * Write-fault handler: make the page writable and let the faulting
+ * store retry. This is the same dance a JIT or a GC write barrier does.
+ */
+static void segv_handler(int sig, siginfo_t *info, void *ctx)
+{
+    (void)ctx;
+    uintptr_t addr = (uintptr_t)info->si_addr;
+    uintptr_t base = (uintptr_t)region;
+
+    if (addr < base || addr >= base + region_pages * page_size) {
+        signal(sig, SIG_DFL);
+        return;
+    }
+    addr &= ~(uintptr_t)(page_size - 1);
+    mprotect((void *)addr, page_size, PROT_READ | PROT_WRITE);
+    fault_count++;
+}
+
+static long vma_limit(void)
+{
+    long limit = 65530;
+    FILE *f = fopen("/proc/sys/vm/max_map_count", "r");
+    if (f) {
+        if (fscanf(f, "%ld", &limit) != 1)
+            limit = 65530;
+        fclose(f);
+    }
+    return limit;
+}
+
+static void print_row(const char *phase, long ops, uint64_t ns)
+{
+    printf("  | %-10s | %10ld | %12.1f | %12.0f |\n",
+           phase, ops, (double)ns / ops, ops * 1e9 / (double)ns);
+}
+
+static int run_size(size_t n)
+{
+    uint64_t t0, t1;
+
+    printf("\n[N = %zu mappings]\n", n);
+    printf("  +------------+------------+--------------+--------------+\n");
+    printf("  | Phase      |        Ops |        ns/op |        ops/s |\n");
+    printf("  +------------+------------+--------------+--------------+\n");
+
+    /* One PROT_NONE reservation, then carve it into single pages */
+    region_pages = n;
+    region = mmap(NULL, n * page_size, PROT_NONE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (region == MAP_FAILED) {
+        perror("mmap reservation");
+        return 1;
+    }
+
+    /* Phase 1: populate */
+    t0 = now_ns();
+    for (size_t i = 0; i < n; i++) {
+        void *p = mmap(page_addr(i), page_size, base_prot(i),
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+        if (p == MAP_FAILED) {
+            perror("mmap MAP_FIXED");
+            printf("  Stopped after %zu pages (raise vm.max_map_count?)\n", i);
+            munmap(region, n * page_size);
+            return 1;
+        }
+    }
+    t1 = now_ns();
+    print_row("populate", n, t1 - t0);
+
+    /* Phase 2: mprotect churn on random pages */
+    t0 = now_ns();
+    for (long i = 0; i < MPROTECT_OPS; i++) {
+        size_t idx = rng_next() % n;
+        mprotect(page_addr(idx), page_size, PROT_READ);
+        mprotect(page_addr(idx), page_size, base_prot(idx));
+    }
+    t1 = now_ns();
+    print_row("mprotect", MPROTECT_OPS * 2, t1 - t0);
+
+    /* Phase 3: write faults on RO pages, fixed up by the handler */
+    long faults = 0;
+    fault_count = 0;
+    t0 = now_ns();
+    for (long i = 0; i < FAULT_OPS; i++) {
+        size_t idx = (rng_next() % n) | 1;   /* odd = RO */
+        if (idx >= n)
+            idx = 1;
+        *(volatile uint8_t *)page_addr(idx) = (uint8_t)i;
+        mprotect(page_addr(idx), page_size, PROT_READ);
+        faults++;
+    }
+    t1 = now_ns();
+    print_row("fault", faults, t1 - t0);
+    if (fault_count != faults)
+        printf("  ** WARNING: expected %ld faults, handler saw %ld **\n",
+               faults, fault_count);
+
+    /* Phase 4: remap random pages in place */
+    t0 = now_ns();
+    for (long i = 0; i < REMAP_OPS; i++) {
+        size_t idx = rng_next() % n;
+        munmap(page_addr(idx), page_size);
+        mmap(page_addr(idx), page_size, base_prot(idx),
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    }
+    t1 = now_ns();
+    print_row("remap", REMAP_OPS * 2, t1 - t0);
+
+    /* Phase 5: teardown */
+    t0 = now_ns();
+    for (size_t i = 0; i < n; i++)
+        munmap(page_addr(i), page_size);
+    t1 = now_ns();
+    print_row("teardown", n, t1 - t0);
+
+    printf("  +------------+------------+--------------+--------------+\n");
+
+    munmap(region, n * page_size);
+    region = NULL;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t sizes[MAX_SIZES] = DEFAULT_SIZES;
+    int num_sizes = 3;
+
+    if (argc > 1) {
+        num_sizes = 0;
+        for (int i = 1; i < argc && num_sizes < MAX_SIZES; i++) {
+            long v = atol(argv[i]);
+            if (v > 0)
+                sizes[num_sizes++] = (size_t)v;
+        }
+    }
+
+    page_size = sysconf(_SC_PAGESIZE);
+    long limit = vma_limit() - VMA_HEADROOM;
+
+    printf("########################################\n");
+    printf(" BENCH 500: mmap/mprotect churn\n");
+    printf(" Page size: %ld, vm.max_map_count: %ld\n", page_size, limit + VMA_HEADROOM);
+    printf("########################################\n");
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = segv_handler;
+    sa.sa_flags = SA_SIGINFO;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGSEGV, &sa, NULL);
+
+    int result = 0;
+    for (int i = 0; i < num_sizes; i++) {
+        size_t n = sizes[i];
+        if ((long)n > limit) {
+            printf("\n[N = %zu] clamped to %ld (vm.max_map_count)\n", n, limit);
+            n = (size_t)limit;
+        }
+        result |= run_size(n);
+    }
+
+    printf("\n");
+    printf("Compare ns/op across N: flat = O(1) tracking, growing = tree depth.\n");
+    printf("Compare native vs box64 at the same N for the emulator overhead.\n");
+
+    return result;
+}
@@ -0,0 +1,222 @@
+/*
+ * 501_thread_create_join
+ *
+ * Benchmark: pthread_create / pthread_join rate for short-lived threads
+ *
+ * Background:
+ *   Under box64, every pthread_create() goes through my_pthread_create()
+ *   (src/libtools/threads.c), which for each thread:
+ *     - InternalMmap()s a fresh stack (2 MB by default)
+ *     - setProtection_stack() → mapallmem / memprot update
+ *     - NewX64Emu() + SetupX64Emu() → new x64emu_t
+ *     - DBGetBlock() on the start routine (pre-JIT)
+ *   and on exit emuthread_destroy() → FreeX64Emu() unmaps the stack
+ *   again (freeProtection). Native pthread caches stacks, box64 does not.
+ *
+ * Scenarios (each reports threads/s and pthread_create() latency):
+ *   1. serial      - create + join one thread at a time
+ *   2. batch       - create BATCH_SIZE threads, then join them all
+ *   3. small-stack - serial, with pthread_attr_setstacksize(64 KiB)
+ *   4. detached    - create detached threads, wait on an atomic counter
+ *
+ * Run:
+ *   ./501_thread_create_join [threads_per_scenario]
+ *   BOX64_DYNAREC=1 box64 ./501_thread_create_join
+ *
+ *   Default: 20000 threads per scenario.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <errno.h>
+
+/* Configuration */
+#define DEFAULT_THREADS   20000  /* Threads per scenario */
+#define BATCH_SIZE        64     /* Threads in flight in batch mode */
+#define SMALL_STACK       (64 * 1024)
+
+static atomic_long work_sink = 0;
+static atomic_int detached_done = 0;
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Thread body: a few instructions of real work so the start routine is
+ * executed (and, under box64, its block compiled) but stays negligible.
+ */
+__attribute__((noinline))
+static void *short_worker(void *arg)
+{
+    long v = (long)arg;
+    for (int i = 0; i < 16; i++)
+        v = v * 31 + i;
+    atomic_fetch_add_explicit(&work_sink, v, memory_order_relaxed);
+    return NULL;
+}
+
+__attribute__((noinline))
+static void *detached_worker(void *arg)
+{
+    short_worker(arg);
+    atomic_fetch_add_explicit(&detached_done, 1, memory_order_release);
+    return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void print_result(const char *name, int count, uint64_t total_ns,
+                         uint64_t *create_ns, int samples)
+{
+    double rate = count * 1e9 / (double)total_ns;
+
+    if (create_ns && samples > 0) {
+        qsort(create_ns, samples, sizeof(uint64_t), cmp_u64);
+        printf("  | %-12s | %8d | %10.0f | %8.1f | %8.1f | %8.1f |\n",
+               name, count, rate,
+               create_ns[samples / 2] / 1000.0,
+               create_ns[(samples * 99) / 100] / 1000.0,
+               create_ns[samples - 1] / 1000.0);
+    } else {
+        printf("  | %-12s | %8d | %10.0f | %8s | %8s | %8s |\n",
+               name, count, rate, "-", "-", "-");
+    }
+}
+
+static int run_serial(const char *name, int count, const pthread_attr_t *attr,
+                      uint64_t *lat)
+{
+    uint64_t start = now_ns();
+    for (int i = 0; i < count; i++) {
+        pthread_t t;
+        uint64_t t0 = now_ns();
+        int ret = pthread_create(&t, attr, short_worker, (void *)(long)i);
+        lat[i] = now_ns() - t0;
+        if (ret != 0) {
+            fprintf(stderr, "[%s] pthread_create failed: %s\n", name, strerror(ret));
+            return 1;
+        }
+        pthread_join(t, NULL);
+    }
+    print_result(name, count, now_ns() - start, lat, count);
+    return 0;
+}
+
+static int run_batch(int count, uint64_t *lat)
+{
+    pthread_t threads[BATCH_SIZE];
+    int done = 0;
+
+    uint64_t start = now_ns();
+    while (done < count) {
+        int n = count - done < BATCH_SIZE ? count - done : BATCH_SIZE;
+        for (int i = 0; i < n; i++) {
+            uint64_t t0 = now_ns();
+            int ret = pthread_create(&threads[i], NULL, short_worker,
+                                     (void *)(long)(done + i));
+            lat[done + i] = now_ns() - t0;
+            if (ret != 0) {
+                fprintf(stderr, "[batch] pthread_create failed: %s\n", strerror(ret));
+                for (int j = 0; j < i; j++)
+                    pthread_join(threads[j], NULL);
+                return 1;
+            }
+        }
+        for (int i = 0; i < n; i++)
+            pthread_join(threads[i], NULL);
+        done += n;
+    }
+    print_result("batch", count, now_ns() - start, lat, count);
+    return 0;
+}
+
+static int run_detached(int count)
+{
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    atomic_store(&detached_done, 0);
+    uint64_t start = now_ns();
+    for (int i = 0; i < count; i++) {
+        pthread_t t;
+        int ret;
+        /* Back off if too many are still alive (EAGAIN) */
+        while ((ret = pthread_create(&t, &attr, detached_worker, (void *)(long)i)) == EAGAIN)
+            usleep(100);
+        if (ret != 0) {
+            fprintf(stderr, "[detached] pthread_create failed: %s\n", strerror(ret));
+            pthread_attr_destroy(&attr);
+            return 1;
+        }
+    }
+    while (atomic_load_explicit(&detached_done, memory_order_acquire) < count)
+        usleep(100);
+    print_result("detached", count, now_ns() - start, NULL, 0);
+
+    pthread_attr_destroy(&attr);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int count = DEFAULT_THREADS;
+    if (argc > 1)
+        count = atoi(argv[1]);
+    if (count < 1)
+        count = 1;
+
+    uint64_t *lat = calloc(count, sizeof(uint64_t));
+    if (!lat) {
+        perror("calloc");
+        return 1;
+    }
+
+    printf("########################################\n");
+    printf(" BENCH 501: Thread create/join rate\n");
+    printf(" Threads per scenario: %d, batch: %d\n", count, BATCH_SIZE);
+    printf("########################################\n\n");
+
+    /* Warm-up: compile the worker and let libc size its stack cache */
+    pthread_t warm;
+    pthread_create(&warm, NULL, short_worker, NULL);
+    pthread_join(warm, NULL);
+
+    printf("  pthread_create() latency in microseconds\n");
+    printf("  +--------------+----------+------------+----------+----------+----------+\n");
+    printf("  | Scenario     |  Threads |  Threads/s |      p50 |      p99 |      max |\n");
+    printf("  +--------------+----------+------------+----------+----------+----------+\n");
+
+    int result = 0;
+    result |= run_serial("serial", count, NULL, lat);
+    result |= run_batch(count, lat);
+
+    pthread_attr_t small;
+    pthread_attr_init(&small);
+    pthread_attr_setstacksize(&small, SMALL_STACK);
+    result |= run_serial("small-stack", count, &small, lat);
+    pthread_attr_destroy(&small);
+
+    result |= run_detached(count);
+
+    printf("  +--------------+----------+------------+----------+----------+----------+\n");
+    printf("\n  sink = %ld\n", atomic_load(&work_sink));
+
+    free(lat);
+    return result;
+}
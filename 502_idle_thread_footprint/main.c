@@ -0,0 +1,224 @@
+/*
+ * 502_idle_thread_footprint
+ *
+ * Benchmark: memory footprint of many parked (idle) threads
+ *
+ * Background:
+ *   Under box64 each emulated thread costs, on top of the native thread:
+ *     - a box64-owned x86 stack (2 MB mapping by default)
+ *     - an x64emu_t (register file, x87/SSE/AVX state, segment caches)
+ *     - a TLS block from setupTLSData() (src/emu/x64tls.c), whose data
+ *       part is rounded up to 64 KiB: (s+0xffff)&~0xffff
+ *   A server with thousands of mostly idle threads pays all of this per
+ *   thread, even when the program has only a few bytes of __thread data.
+ *
+ * What this benchmark measures:
+ *   For each thread count N (default 1000, 5000, 10000):
+ *     - spawn N threads that touch their __thread data and then park on
+ *       a condition variable
+ *     - sample VmRSS, VmSize and the number of VMAs (/proc/self/maps)
+ *     - report the delta against the idle baseline, total and per thread
+ *     - wake and join all threads before the next N
+ *
+ * Run:
+ *   ./502_idle_thread_footprint [N ...] [--stack KiB]
+ *   BOX64_DYNAREC=1 box64 ./502_idle_thread_footprint
+ *
+ *   --stack sets the pthread stack size (default: libc default).
+ *   N is limited by ulimit -u, kernel.threads-max and vm.max_map_count.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdatomic.h>
+
+/* Configuration */
+#define DEFAULT_SIZES     { 1000, 5000, 10000 }
+#define MAX_SIZES         16
+#define TLS_BYTES         256   /* __thread payload touched by each thread */
+
+/* A small, realistic amount of per-thread data */
+static __thread char tls_payload[TLS_BYTES];
+static __thread long tls_counter = 1;
+
+static pthread_mutex_t park_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t park_cond = PTHREAD_COND_INITIALIZER;
+static int release_threads = 0;
+static atomic_int threads_parked = 0;
+
+typedef struct {
+    long rss_kb;
+    long vm_kb;
+    long vmas;
+} footprint_t;
+
+static long read_status_kb(const char *key)
+{
+    char line[256];
+    long value = -1;
+    size_t len = strlen(key);
+    FILE *f = fopen("/proc/self/status", "r");
+    if (!f)
+        return -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, key, len) == 0) {
+            value = atol(line + len);
+            break;
+        }
+    }
+    fclose(f);
+    return value;
+}
+
+static long count_vmas(void)
+{
+    char line[512];
+    long count = 0;
+    FILE *f = fopen("/proc/self/maps", "r");
+    if (!f)
+        return -1;
+    while (fgets(line, sizeof(line), f)) {
+        /* Long lines (paths) may need several reads; count newlines only */
+        if (strchr(line, '\n'))
+            count++;
+    }
+    fclose(f);
+    return count;
+}
+
+static void sample(footprint_t *fp)
+{
+    fp->rss_kb = read_status_kb("VmRSS:");
+    fp->vm_kb = read_status_kb("VmSize:");
+    fp->vmas = count_vmas();
+}
+
+static void *parked_worker(void *arg)
+{
+    /* Touch TLS so it is really instantiated for this thread */
+    memset(tls_payload, (int)(long)arg, sizeof(tls_payload));
+    tls_counter += (long)arg;
+
+    pthread_mutex_lock(&park_mutex);
+    atomic_fetch_add(&threads_parked, 1);
+    while (!release_threads)
+        pthread_cond_wait(&park_cond, &park_mutex);
+    pthread_mutex_unlock(&park_mutex);
+
+    return (void *)(tls_counter + tls_payload[0]);
+}
+
+static int run_size(int n, const pthread_attr_t *attr, footprint_t *base)
+{
+    pthread_t *threads = calloc(n, sizeof(pthread_t));
+    if (!threads) {
+        perror("calloc");
+        return 1;
+    }
+
+    release_threads = 0;
+    atomic_store(&threads_parked, 0);
+
+    int created = 0;
+    for (; created < n; created++) {
+        int ret = pthread_create(&threads[created], attr, parked_worker,
+                                 (void *)(long)created);
+        if (ret != 0) {
+            printf("  pthread_create failed at thread %d: %s\n",
+                   created, strerror(ret));
+            break;
+        }
+    }
+    while (atomic_load(&threads_parked) < created)
+        usleep(1000);
+
+    footprint_t fp;
+    sample(&fp);
+
+    if (created > 0) {
+        long d_rss = fp.rss_kb - base->rss_kb;
+        long d_vm = fp.vm_kb - base->vm_kb;
+        long d_vmas = fp.vmas - base->vmas;
+        printf("  | %7d | %10ld | %8.1f | %11ld | %9.1f | %6ld | %6.2f |\n",
+               created,
+               d_rss, (double)d_rss / created,
+               d_vm, (double)d_vm / created,
+               d_vmas, (double)d_vmas / created);
+    }
+
+    pthread_mutex_lock(&park_mutex);
+    release_threads = 1;
+    pthread_cond_broadcast(&park_cond);
+    pthread_mutex_unlock(&park_mutex);
+
+    for (int i = 0; i < created; i++)
+        pthread_join(threads[i], NULL);
+
+    free(threads);
+    return created == n ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+    int sizes[MAX_SIZES] = DEFAULT_SIZES;
+    int num_sizes = 3;
+    int user_sizes = 0;
+    long stack_kb = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--stack") == 0 && i + 1 < argc) {
+            stack_kb = atol(argv[++i]);
+        } else if (atoi(argv[i]) > 0 && num_sizes < MAX_SIZES) {
+            if (!user_sizes) {
+                user_sizes = 1;
+                num_sizes = 0;
+            }
+            sizes[num_sizes++] = atoi(argv[i]);
+        }
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (stack_kb > 0)
+        pthread_attr_setstacksize(&attr, stack_kb * 1024);
+    size_t stack_size = 0;
+    pthread_attr_getstacksize(&attr, &stack_size);
+
+    printf("########################################\n");
+    printf(" BENCH 502: Idle thread memory footprint\n");
+    printf(" Stack size: %zu KiB, __thread payload: %d bytes\n",
+           stack_size / 1024, TLS_BYTES);
+    printf("########################################\n\n");
+
+    /* One warm-up thread so libc/box64 one-time allocations are in the baseline */
+    pthread_t warm;
+    release_threads = 1;
+    if (pthread_create(&warm, &attr, parked_worker, NULL) == 0)
+        pthread_join(warm, NULL);
+
+    footprint_t base;
+    sample(&base);
+    printf("Baseline: VmRSS %ld KiB, VmSize %ld KiB, %ld VMAs\n\n",
+           base.rss_kb, base.vm_kb, base.vmas);
+
+    printf("  Deltas against baseline (KiB)\n");
+    printf("  +---------+------------+----------+-------------+-----------+--------+--------+\n");
+    printf("  | Threads |    RSS KiB | RSS/thr  |  VmSize KiB | Vm/thr    |  VMAs  | VMA/thr|\n");
+    printf("  +---------+------------+----------+-------------+-----------+--------+--------+\n");
+
+    int result = 0;
+    for (int i = 0; i < num_sizes; i++)
+        result |= run_size(sizes[i], &attr, &base);
+
+    printf("  +---------+------------+----------+-------------+-----------+--------+--------+\n");
+    printf("\n");
+    printf("Native: RSS/thr is mostly the touched stack pages + TCB/TLS.\n");
+    printf("box64:  add the x86 stack, x64emu_t and the TLS block per thread.\n");
+
+    pthread_attr_destroy(&attr);
+    return result;
+}
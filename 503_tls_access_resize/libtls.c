@@ -0,0 +1,27 @@
+/*
+ * libtls_N.so - Shared library with an initialized __thread array.
+ *
+ * Built several times with different TLS_LIB_ID values. Each copy has its
+ * own .tdata section, so every dlopen grows the process TLS size. Under
+ * box64 that bumps context->tlssize, and each thread that then calls into
+ * the library goes through __tls_get_addr → refreshTLSData() →
+ * resizeTLSData() the first time.
+ */
+
+#ifndef TLS_LIB_ID
+#define TLS_LIB_ID 0
+#endif
+
+#define TLS_LIB_WORDS 512   /* 4 KiB of .tdata per library */
+
+__thread long lib_tls_data[TLS_LIB_WORDS] = { TLS_LIB_ID + 1 };
+
+__attribute__((visibility("default")))
+long tls_lib_touch(long n) {
+    long sum = 0;
+    for (long i = 0; i < n; i++) {
+        lib_tls_data[i & (TLS_LIB_WORDS - 1)] += i;
+        sum += lib_tls_data[(i * 7) & (TLS_LIB_WORDS - 1)];
+    }
+    return sum;
+}
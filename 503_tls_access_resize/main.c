@@ -0,0 +1,252 @@
+/*
+ * 503_tls_access_resize
+ *
+ * Benchmark: __thread access throughput and TLS resize latency spikes
+ *
+ * Background:
+ *   x86_64 __thread variables in the main executable are read and written
+ *   as fs:-relative accesses; under box64 the FS base of each thread is
+ *   emu->segs_offs[_FS], pointing into the block set up by setupTLSData()
+ *   (src/emu/x64tls.c).
+ *
+ *   Every dlopen of a library with a .tdata/.tbss section grows
+ *   context->tlssize. Threads notice the next time they go through
+ *   refreshTLSData() (e.g. __tls_get_addr for the new library's TLS):
+ *     if(ptr->tlssize != emu->context->tlssize)
+ *         ptr = resizeTLSData(emu->context, ptr);
+ *   so after each such dlopen, every thread pays one resize (allocate a
+ *   new block, copy, rebuild DTS) on its first TLS access into the library.
+ *
+ * Test design:
+ *   - NUM_HOT_THREADS threads loop on a main-executable __thread counter
+ *     in chunks of CHUNK_OPS increments, timing each chunk
+ *   - A loader thread dlopens ./libtls_0.so .. ./libtls_{N-1}.so, one
+ *     every LOAD_INTERVAL_MS; each library has 4 KiB of .tdata
+ *   - When a hot thread sees a new library, it calls tls_lib_touch() in
+ *     it and times that first call (this is where the resize happens),
+ *     then keeps calling all loaded libraries' tls_lib_touch() once per
+ *     chunk
+ *
+ * Reported:
+ *   - per window (between two dlopens): per-thread fs:-relative increments/s
+ *     and the worst chunk time seen by any thread
+ *   - per library: dlopen time, and first-touch latency (avg / max over
+ *     threads) versus the steady-state touch cost
+ *
+ * Run (from the directory containing libtls_*.so):
+ *   ./503_tls_access_resize
+ *   BOX64_DYNAREC=1 box64 ./503_tls_access_resize
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <dlfcn.h>
+#include <time.h>
+
+/* Configuration */
+#define NUM_HOT_THREADS   4      /* Threads hammering __thread data */
+#define NUM_TLS_LIBS      8      /* libtls_0.so .. libtls_7.so */
+#define LOAD_INTERVAL_MS  200    /* Time between two dlopens */
+#define CHUNK_OPS         4096   /* __thread increments per timed chunk */
+#define TOUCH_OPS         64     /* Iterations per tls_lib_touch() call */
+
+typedef long (*touch_fn)(long);
+
+/* Main-executable TLS: accessed fs:-relative (local-exec model) */
+static __thread long hot_counter = 0;
+
+static touch_fn lib_touch[NUM_TLS_LIBS];
+static void *lib_handle[NUM_TLS_LIBS];
+static uint64_t lib_dlopen_ns[NUM_TLS_LIBS];
+static atomic_int libs_loaded = 0;
+static atomic_int stop_threads = 0;
+static atomic_int threads_ready = 0;
+static atomic_long sink = 0;
+
+/* Windows are indexed by number of loaded libraries (0..NUM_TLS_LIBS) */
+typedef struct {
+    long ops[NUM_TLS_LIBS + 1];
+    uint64_t ns[NUM_TLS_LIBS + 1];
+    uint64_t worst_chunk_ns[NUM_TLS_LIBS + 1];
+    uint64_t first_touch_ns[NUM_TLS_LIBS];
+    uint64_t steady_touch_ns[NUM_TLS_LIBS];
+    long steady_touch_calls[NUM_TLS_LIBS];
+} thread_stats_t;
+
+static thread_stats_t stats[NUM_HOT_THREADS];
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+__attribute__((noinline))
+static void hot_tls_chunk(void)
+{
+    for (int i = 0; i < CHUNK_OPS; i++) {
+        hot_counter += i;
+        __asm__ volatile("" ::: "memory");   /* keep each access */
+    }
+}
+
+static void *hot_thread(void *arg)
+{
+    int id = (int)(long)arg;
+    thread_stats_t *st = &stats[id];
+    int seen = 0;
+    long acc = 0;
+
+    atomic_fetch_add(&threads_ready, 1);
+
+    while (!atomic_load_explicit(&stop_threads, memory_order_relaxed)) {
+        int loaded = atomic_load_explicit(&libs_loaded, memory_order_acquire);
+
+        /* First access into each newly loaded library: resize happens here */
+        while (seen < loaded) {
+            uint64_t t0 = now_ns();
+            acc += lib_touch[seen](TOUCH_OPS);
+            st->first_touch_ns[seen] = now_ns() - t0;
+            seen++;
+        }
+
+        uint64_t t0 = now_ns();
+        hot_tls_chunk();
+        uint64_t t1 = now_ns();
+
+        st->ops[seen] += CHUNK_OPS;
+        st->ns[seen] += t1 - t0;
+        if (t1 - t0 > st->worst_chunk_ns[seen])
+            st->worst_chunk_ns[seen] = t1 - t0;
+
+        /* Steady-state access to every loaded library's TLS */
+        for (int l = 0; l < seen; l++) {
+            uint64_t a = now_ns();
+            acc += lib_touch[l](TOUCH_OPS);
+            st->steady_touch_ns[l] += now_ns() - a;
+            st->steady_touch_calls[l]++;
+        }
+    }
+
+    atomic_fetch_add(&sink, acc + hot_counter);
+    return NULL;
+}
+
+static void *loader_thread(void *arg)
+{
+    (void)arg;
+    char path[64];
+
+    while (atomic_load(&threads_ready) < NUM_HOT_THREADS)
+        usleep(1000);
+
+    for (int l = 0; l < NUM_TLS_LIBS; l++) {
+        usleep(LOAD_INTERVAL_MS * 1000);
+
+        snprintf(path, sizeof(path), "./libtls_%d.so", l);
+        uint64_t t0 = now_ns();
+        lib_handle[l] = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+        lib_dlopen_ns[l] = now_ns() - t0;
+        if (!lib_handle[l]) {
+            fprintf(stderr, "[Loader] dlopen(%s) failed: %s\n", path, dlerror());
+            break;
+        }
+        lib_touch[l] = (touch_fn)dlsym(lib_handle[l], "tls_lib_touch");
+        if (!lib_touch[l]) {
+            fprintf(stderr, "[Loader] dlsym(tls_lib_touch) failed in %s\n", path);
+            break;
+        }
+        atomic_store_explicit(&libs_loaded, l + 1, memory_order_release);
+    }
+
+    usleep(LOAD_INTERVAL_MS * 1000);
+    atomic_store(&stop_threads, 1);
+    return NULL;
+}
+
+int main(void)
+{
+    pthread_t hot[NUM_HOT_THREADS];
+    pthread_t loader;
+
+    printf("########################################\n");
+    printf(" BENCH 503: TLS access and resize cost\n");
+    printf(" %d hot threads, %d TLS libraries, %d ms apart\n",
+           NUM_HOT_THREADS, NUM_TLS_LIBS, LOAD_INTERVAL_MS);
+    printf("########################################\n\n");
+
+    memset(stats, 0, sizeof(stats));
+
+    for (int i = 0; i < NUM_HOT_THREADS; i++)
+        pthread_create(&hot[i], NULL, hot_thread, (void *)(long)i);
+    pthread_create(&loader, NULL, loader_thread, NULL);
+
+    pthread_join(loader, NULL);
+    for (int i = 0; i < NUM_HOT_THREADS; i++)
+        pthread_join(hot[i], NULL);
+
+    int loaded = atomic_load(&libs_loaded);
+
+    printf("fs:-relative __thread increments, per window between dlopens\n");
+    printf("  +------------+--------------+-----------------+\n");
+    printf("  | Libs loaded| Mincr/s/thr  | worst chunk (us)|\n");
+    printf("  +------------+--------------+-----------------+\n");
+    for (int w = 0; w <= loaded; w++) {
+        long ops = 0;
+        uint64_t ns = 0, worst = 0;
+        for (int t = 0; t < NUM_HOT_THREADS; t++) {
+            ops += stats[t].ops[w];
+            ns += stats[t].ns[w];
+            if (stats[t].worst_chunk_ns[w] > worst)
+                worst = stats[t].worst_chunk_ns[w];
+        }
+        /* ns is summed over threads, so this is the per-thread rate */
+        printf("  | %10d | %12.1f | %15.1f |\n", w,
+               ns ? ops * 1e3 / (double)ns : 0.0,
+               worst / 1000.0);
+    }
+    printf("  +------------+--------------+-----------------+\n\n");
+
+    printf("Per-library cost (microseconds)\n");
+    printf("  +-------+------------+------------------+------------------+--------------+\n");
+    printf("  | Lib   |  dlopen    | first touch avg  | first touch max  | steady touch |\n");
+    printf("  +-------+------------+------------------+------------------+--------------+\n");
+    for (int l = 0; l < loaded; l++) {
+        uint64_t sum = 0, max = 0, steady_ns = 0;
+        long steady_calls = 0;
+        for (int t = 0; t < NUM_HOT_THREADS; t++) {
+            sum += stats[t].first_touch_ns[l];
+            if (stats[t].first_touch_ns[l] > max)
+                max = stats[t].first_touch_ns[l];
+            steady_ns += stats[t].steady_touch_ns[l];
+            steady_calls += stats[t].steady_touch_calls[l];
+        }
+        printf("  | %5d | %10.1f | %16.2f | %16.2f | %12.3f |\n", l,
+               lib_dlopen_ns[l] / 1000.0,
+               sum / 1000.0 / NUM_HOT_THREADS,
+               max / 1000.0,
+               steady_calls ? steady_ns / 1000.0 / steady_calls : 0.0);
+    }
+    printf("  +-------+------------+------------------+------------------+--------------+\n\n");
+
+    if (loaded < NUM_TLS_LIBS) {
+        printf("WARNING: only %d/%d libraries loaded.\n", loaded, NUM_TLS_LIBS);
+        printf("  Run from the directory containing libtls_*.so.\n\n");
+    }
+
+    printf("first touch >> steady touch: cost of the per-thread TLS resize.\n");
+    printf("Mincr/s dropping as libs load: TLS access got slower after resize.\n");
+
+    for (int l = 0; l < loaded; l++)
+        dlclose(lib_handle[l]);
+
+    printf("\n  sink = %ld\n", atomic_load(&sink));
+    return loaded == NUM_TLS_LIBS ? 0 : 1;
+}
@@ -0,0 +1,291 @@
+/*
+ * 504_cancel_cleanup
+ *
+ * Benchmark: pthread_cleanup_push/pop throughput and cancellation latency
+ *
+ * Background:
+ *   In C (no -fexceptions), glibc's pthread_cleanup_push() expands to a
+ *   __sigsetjmp() plus __pthread_register_cancel(), and
+ *   pthread_cleanup_pop() to __pthread_unregister_cancel(). Box64 wraps
+ *   these (src/libtools/threads.c): my___pthread_register_cancel() pushes
+ *   the unwind buffer on the emuthread_t `cancels` stack, growing it with
+ *   box_realloc() by 8 entries whenever cancel_size == cancel_cap.
+ *   On cancellation, emuthread_cancel() longjmps into each registered
+ *   buffer in LIFO order and re-enters DynaRun() to run the x86 cleanup.
+ *
+ * Scenarios:
+ *   1. push/pop flat   - one push/pop pair per loop iteration
+ *   2. push/pop nested - D nested levels (D = 1, 8, 32, 128) via recursion,
+ *                        crossing several cancel_cap growth steps; plus the
+ *                        first vs second D=128 nest in a fresh thread, which
+ *                        isolates the box_realloc() growth
+ *   3. deferred cancel - target computes and calls pthread_testcancel()
+ *                        every TESTCANCEL_EVERY iterations
+ *   4. blocked cancel  - target is blocked in a cancellation point (pause)
+ *   5. async cancel    - target in PTHREAD_CANCEL_ASYNCHRONOUS mode, pure
+ *                        compute loop with no cancellation points
+ *
+ *   1-2 report ns per push+pop; 3-5 report pthread_cancel() → cleanup
+ *   handler latency and pthread_cancel() → pthread_join() return.
+ *
+ * Run:
+ *   ./504_cancel_cleanup
+ *   BOX64_DYNAREC=1 box64 ./504_cancel_cleanup
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <time.h>
+
+/* Configuration */
+#define PUSHPOP_ITERATIONS  1000000  /* Flat push/pop pairs */
+#define NESTED_ROUNDS       20000    /* Nested rounds per depth */
+#define FRESH_THREADS       200      /* Threads for the first-nest rows */
+#define CANCEL_SAMPLES      200      /* Cancellations per scenario */
+#define TESTCANCEL_EVERY    1024     /* Compute iterations between testcancel */
+
+static const int nested_depths[] = { 1, 8, 32, 128 };
+
+static atomic_int target_started = 0;
+static volatile uint64_t cleanup_ns = 0;
+static volatile long cleanup_runs = 0;
+static volatile long compute_sink = 0;
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void noop_cleanup(void *arg)
+{
+    (void)arg;
+    cleanup_runs++;
+}
+
+static void stamp_cleanup(void *arg)
+{
+    (void)arg;
+    cleanup_ns = now_ns();
+}
+
+/* ── Scenario 1: flat push/pop ───────────────────────────────────── */
+
+/* Kept out of line so the sigsetjmp() in the push macro sees no loop state */
+__attribute__((noinline))
+static void pushpop_one(long i)
+{
+    pthread_cleanup_push(noop_cleanup, NULL);
+    compute_sink += i;
+    pthread_cleanup_pop(0);
+}
+
+__attribute__((noinline))
+static void pushpop_flat(long n)
+{
+    for (long i = 0; i < n; i++)
+        pushpop_one(i);
+}
+
+/* ── Scenario 2: nested push/pop ─────────────────────────────────── */
+
+__attribute__((noinline))
+static void pushpop_nested(int depth)
+{
+    if (depth == 0)
+        return;
+    pthread_cleanup_push(noop_cleanup, NULL);
+    pushpop_nested(depth - 1);
+    pthread_cleanup_pop(0);
+}
+
+/*
+ * The cancels array lives as long as the thread, so in the loops above it
+ * only grows on the first round. Here a fresh thread times its first
+ * deep nest (cap grows 0 -> 8 -> ... -> depth) against its second.
+ */
+static uint64_t fresh_first_ns, fresh_second_ns;
+
+static void *fresh_nest_thread(void *arg)
+{
+    int depth = (int)(long)arg;
+    uint64_t t0 = now_ns();
+    pushpop_nested(depth);
+    uint64_t t1 = now_ns();
+    pushpop_nested(depth);
+    uint64_t t2 = now_ns();
+    fresh_first_ns += t1 - t0;
+    fresh_second_ns += t2 - t1;
+    return NULL;
+}
+
+static void run_fresh_nest(int depth)
+{
+    fresh_first_ns = fresh_second_ns = 0;
+    for (int r = 0; r < FRESH_THREADS; r++) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, fresh_nest_thread, (void *)(long)depth) != 0) {
+            perror("pthread_create");
+            return;
+        }
+        pthread_join(t, NULL);
+    }
+    printf("  | fresh d=%-3d #1 | %8d | %10.1f |\n",
+           depth, FRESH_THREADS * depth,
+           (double)fresh_first_ns / ((long)FRESH_THREADS * depth));
+    printf("  | fresh d=%-3d #2 | %8d | %10.1f |\n",
+           depth, FRESH_THREADS * depth,
+           (double)fresh_second_ns / ((long)FRESH_THREADS * depth));
+}
+
+static void run_pushpop(void)
+{
+    printf("  +----------------+----------+------------+\n");
+    printf("  | Push/pop       |    Pairs |  ns/pair   |\n");
+    printf("  +----------------+----------+------------+\n");
+
+    uint64_t t0 = now_ns();
+    pushpop_flat(PUSHPOP_ITERATIONS);
+    uint64_t t1 = now_ns();
+    printf("  | flat           | %8d | %10.1f |\n",
+           PUSHPOP_ITERATIONS, (double)(t1 - t0) / PUSHPOP_ITERATIONS);
+
+    for (size_t d = 0; d < sizeof(nested_depths) / sizeof(nested_depths[0]); d++) {
+        int depth = nested_depths[d];
+        long pairs = (long)NESTED_ROUNDS * depth;
+        t0 = now_ns();
+        for (int r = 0; r < NESTED_ROUNDS; r++)
+            pushpop_nested(depth);
+        t1 = now_ns();
+        printf("  | nested d=%-4d  | %8ld | %10.1f |\n",
+               depth, pairs, (double)(t1 - t0) / pairs);
+    }
+    run_fresh_nest(nested_depths[sizeof(nested_depths) / sizeof(nested_depths[0]) - 1]);
+    printf("  +----------------+----------+------------+\n\n");
+}
+
+/* ── Scenarios 3-5: cancellation latency ─────────────────────────── */
+
+static void *deferred_target(void *arg)
+{
+    (void)arg;
+    volatile long x = 1;
+    pthread_cleanup_push(stamp_cleanup, NULL);
+    atomic_store(&target_started, 1);
+    for (long i = 0; ; i++) {
+        x = x * 3 + i;
+        if ((i % TESTCANCEL_EVERY) == 0) {
+            compute_sink = x;
+            pthread_testcancel();
+        }
+    }
+    pthread_cleanup_pop(0);
+    return NULL;
+}
+
+static void *blocked_target(void *arg)
+{
+    (void)arg;
+    pthread_cleanup_push(stamp_cleanup, NULL);
+    atomic_store(&target_started, 1);
+    for (;;)
+        pause();
+    pthread_cleanup_pop(0);
+    return NULL;
+}
+
+static void *async_target(void *arg)
+{
+    (void)arg;
+    volatile long x = 1;
+    int old;
+    pthread_cleanup_push(stamp_cleanup, NULL);
+    pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &old);
+    atomic_store(&target_started, 1);
+    for (long i = 0; ; i++)
+        x = x * 3 + i;
+    pthread_cleanup_pop(0);
+    return NULL;
+}
+
+static void run_cancel(const char *name, void *(*target)(void *),
+                       uint64_t *to_cleanup, uint64_t *to_join)
+{
+    int n = 0;
+
+    for (int s = 0; s < CANCEL_SAMPLES; s++) {
+        pthread_t t;
+        atomic_store(&target_started, 0);
+        cleanup_ns = 0;
+
+        if (pthread_create(&t, NULL, target, NULL) != 0) {
+            perror("pthread_create");
+            break;
+        }
+        while (!atomic_load(&target_started))
+            sched_yield();
+        usleep(500);   /* let it settle into its loop */
+
+        uint64_t t0 = now_ns();
+        pthread_cancel(t);
+        void *ret;
+        pthread_join(t, &ret);
+        uint64_t t1 = now_ns();
+
+        if (ret != PTHREAD_CANCELED || cleanup_ns == 0) {
+            printf("  ** [%s] sample %d: thread not cancelled cleanly **\n", name, s);
+            continue;
+        }
+        to_cleanup[n] = cleanup_ns - t0;
+        to_join[n] = t1 - t0;
+        n++;
+    }
+
+    if (n == 0)
+        return;
+    qsort(to_cleanup, n, sizeof(uint64_t), cmp_u64);
+    qsort(to_join, n, sizeof(uint64_t), cmp_u64);
+    printf("  | %-10s | %5d | %9.1f | %9.1f | %9.1f | %9.1f |\n", name, n,
+           to_cleanup[n / 2] / 1000.0, to_cleanup[(n * 99) / 100] / 1000.0,
+           to_join[n / 2] / 1000.0, to_join[(n * 99) / 100] / 1000.0);
+}
+
+int main(void)
+{
+    static uint64_t to_cleanup[CANCEL_SAMPLES];
+    static uint64_t to_join[CANCEL_SAMPLES];
+
+    printf("########################################\n");
+    printf(" BENCH 504: Cleanup handlers and cancellation\n");
+    printf("########################################\n\n");
+
+    run_pushpop();
+
+    printf("  pthread_cancel() latency in microseconds\n");
+    printf("  +------------+-------+-----------+-----------+-----------+-----------+\n");
+    printf("  | Mode       |     n | cleanup50 | cleanup99 |   join50  |   join99  |\n");
+    printf("  +------------+-------+-----------+-----------+-----------+-----------+\n");
+    run_cancel("deferred", deferred_target, to_cleanup, to_join);
+    run_cancel("blocked", blocked_target, to_cleanup, to_join);
+    run_cancel("async", async_target, to_cleanup, to_join);
+    printf("  +------------+-------+-----------+-----------+-----------+-----------+\n");
+
+    printf("\n");
+    printf("fresh #1 - fresh #2 = cancel_cap growth cost per push.\n");
+    printf("async >> deferred: cost of interrupting JIT code for the cancel signal.\n");
+    printf("\n  cleanup_runs = %ld (push/pop with execute=0 never runs it)\n", cleanup_runs);
+    return cleanup_runs == 0 ? 0 : 1;
+}
@@ -0,0 +1,266 @@
+/*
+ * 505_pthread_sync_pingpong
+ *
+ * Benchmark: mutex / condvar / barrier / rwlock throughput across 1..N threads
+ *
+ * Background:
+ *   Box64 does not emulate libpthread's synchronization primitives: the
+ *   x86 pthread_mutex_*, pthread_cond_*, pthread_barrier_* and
+ *   pthread_rwlock_* calls go through wrappedlibpthread.c to the native
+ *   ARM64 libpthread (with PTHREAD_ATTR_ALIGN adjustments on some
+ *   platforms). Each call still pays the x86 → native bridge, and the
+ *   x86 code around it runs through the dynarec. This benchmark measures
+ *   the per-op cost of that path at several thread counts, so native and
+ *   emulated runs can be put side by side.
+ *
+ * Scenarios (each at 1/2/4/8 threads, capped by the command line):
+ *   1. mutex    - every thread loops lock / increment / unlock on one
+ *                 shared mutex (1 thread = uncontended)
+ *   2. condvar  - a token is passed round-robin between threads; each
+ *                 thread waits on its own condvar under a shared mutex
+ *                 and signals the next one (2+ threads)
+ *   3. barrier  - all threads loop on pthread_barrier_wait() (2+ threads)
+ *   4. rwlock   - every thread loops rdlock / read / unlock on one shared
+ *                 rwlock; read-side scaling
+ *
+ *   mutex / rwlock report ns per lock+unlock (wall time / total ops),
+ *   condvar reports ns per handoff, barrier ns per round.
+ *
+ * Run:
+ *   ./505_pthread_sync_pingpong [max_threads] [--tsv]
+ *   BOX64_DYNAREC=1 box64 ./505_pthread_sync_pingpong
+ *
+ *   --tsv prints "primitive<TAB>threads<TAB>ns_per_op" lines only, so a
+ *   native and an emulated run can be joined into one table.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <time.h>
+
+/* Configuration */
+#define MAX_THREADS       8
+#define MUTEX_OPS         2000000  /* Total lock/unlock pairs per run */
+#define RWLOCK_OPS        2000000  /* Total rdlock/unlock pairs per run */
+#define CONDVAR_HANDOFFS  20000    /* Total token handoffs per run */
+#define BARRIER_ROUNDS    10000    /* Barrier rounds per run */
+
+static const int thread_counts[] = { 1, 2, 4, 8 };
+
+static int tsv_output = 0;
+
+static pthread_barrier_t start_barrier;
+static pthread_mutex_t shared_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t shared_rwlock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_barrier_t round_barrier;
+static volatile long shared_counter = 0;
+
+/* Condvar ring: token owner is `turn`, thread i waits on cond[i] */
+static pthread_mutex_t ring_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ring_cond[MAX_THREADS];
+static int turn = 0;
+static long handoffs_left = 0;
+
+typedef struct {
+    int id;
+    int nthreads;
+    long ops;
+} worker_arg_t;
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* ── Workers ─────────────────────────────────────────────────────── */
+
+static void *mutex_worker(void *arg)
+{
+    worker_arg_t *w = arg;
+    pthread_barrier_wait(&start_barrier);
+    for (long i = 0; i < w->ops; i++) {
+        pthread_mutex_lock(&shared_mutex);
+        shared_counter++;
+        pthread_mutex_unlock(&shared_mutex);
+    }
+    return NULL;
+}
+
+static void *rwlock_worker(void *arg)
+{
+    worker_arg_t *w = arg;
+    long acc = 0;
+    pthread_barrier_wait(&start_barrier);
+    for (long i = 0; i < w->ops; i++) {
+        pthread_rwlock_rdlock(&shared_rwlock);
+        acc += shared_counter;
+        pthread_rwlock_unlock(&shared_rwlock);
+    }
+    return (void *)acc;
+}
+
+static void *condvar_worker(void *arg)
+{
+    worker_arg_t *w = arg;
+    int next = (w->id + 1) % w->nthreads;
+    pthread_barrier_wait(&start_barrier);
+
+    pthread_mutex_lock(&ring_mutex);
+    for (;;) {
+        while (turn != w->id && handoffs_left > 0)
+            pthread_cond_wait(&ring_cond[w->id], &ring_mutex);
+        if (handoffs_left <= 0)
+            break;
+        handoffs_left--;
+        turn = next;
+        pthread_cond_signal(&ring_cond[next]);
+    }
+    /* Wake everyone still waiting so they see handoffs_left == 0 */
+    for (int i = 0; i < w->nthreads; i++)
+        pthread_cond_signal(&ring_cond[i]);
+    pthread_mutex_unlock(&ring_mutex);
+    return NULL;
+}
+
+static void *barrier_worker(void *arg)
+{
+    worker_arg_t *w = arg;
+    pthread_barrier_wait(&start_barrier);
+    for (long i = 0; i < w->ops; i++)
+        pthread_barrier_wait(&round_barrier);
+    return NULL;
+}
+
+/* ── Driver ──────────────────────────────────────────────────────── */
+
+/*
+ * Start nthreads workers, release them together and time until the last
+ * one is joined. The main thread is the extra party on start_barrier.
+ */
+static uint64_t run_workers(void *(*fn)(void *), int nthreads, long ops_per_thread)
+{
+    pthread_t th[MAX_THREADS];
+    worker_arg_t args[MAX_THREADS];
+
+    pthread_barrier_init(&start_barrier, NULL, nthreads + 1);
+    for (int i = 0; i < nthreads; i++) {
+        args[i].id = i;
+        args[i].nthreads = nthreads;
+        args[i].ops = ops_per_thread;
+        pthread_create(&th[i], NULL, fn, &args[i]);
+    }
+
+    pthread_barrier_wait(&start_barrier);
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < nthreads; i++)
+        pthread_join(th[i], NULL);
+    uint64_t t1 = now_ns();
+
+    pthread_barrier_destroy(&start_barrier);
+    return t1 - t0;
+}
+
+static void report(const char *name, int nthreads, long ops, uint64_t ns)
+{
+    double per_op = (double)ns / ops;
+    if (tsv_output)
+        printf("%s\t%d\t%.1f\n", name, nthreads, per_op);
+    else
+        printf("  | %-8s | %7d | %9ld | %10.1f | %9.2f |\n",
+               name, nthreads, ops, per_op, ops * 1e3 / (double)ns);
+}
+
+static void bench_mutex(int nthreads)
+{
+    long per = MUTEX_OPS / nthreads;
+    shared_counter = 0;
+    uint64_t ns = run_workers(mutex_worker, nthreads, per);
+    report("mutex", nthreads, per * nthreads, ns);
+    if (shared_counter != per * nthreads && !tsv_output)
+        printf("  ** WARNING: counter %ld, expected %ld **\n",
+               shared_counter, per * nthreads);
+}
+
+static void bench_rwlock(int nthreads)
+{
+    long per = RWLOCK_OPS / nthreads;
+    uint64_t ns = run_workers(rwlock_worker, nthreads, per);
+    report("rwlock", nthreads, per * nthreads, ns);
+}
+
+static void bench_condvar(int nthreads)
+{
+    turn = 0;
+    handoffs_left = CONDVAR_HANDOFFS;
+    for (int i = 0; i < nthreads; i++)
+        pthread_cond_init(&ring_cond[i], NULL);
+    uint64_t ns = run_workers(condvar_worker, nthreads, 0);
+    for (int i = 0; i < nthreads; i++)
+        pthread_cond_destroy(&ring_cond[i]);
+    report("condvar", nthreads, CONDVAR_HANDOFFS, ns);
+}
+
+static void bench_barrier(int nthreads)
+{
+    pthread_barrier_init(&round_barrier, NULL, nthreads);
+    uint64_t ns = run_workers(barrier_worker, nthreads, BARRIER_ROUNDS);
+    pthread_barrier_destroy(&round_barrier);
+    report("barrier", nthreads, BARRIER_ROUNDS, ns);
+}
+
+int main(int argc, char *argv[])
+{
+    int max_threads = MAX_THREADS;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--tsv") == 0)
+            tsv_output = 1;
+        else
+            max_threads = atoi(argv[i]);
+    }
+    if (max_threads < 1)
+        max_threads = 1;
+    if (max_threads > MAX_THREADS)
+        max_threads = MAX_THREADS;
+
+    const int ncounts = sizeof(thread_counts) / sizeof(thread_counts[0]);
+
+    if (!tsv_output) {
+        printf("########################################\n");
+        printf(" BENCH 505: pthread sync primitives\n");
+        printf(" Threads: 1..%d, online CPUs: %ld\n",
+               max_threads, sysconf(_SC_NPROCESSORS_ONLN));
+        printf("########################################\n\n");
+
+        printf("  +----------+---------+-----------+------------+-----------+\n");
+        printf("  | Primitive| Threads |       Ops |   ns/op    |   Mops/s  |\n");
+        printf("  +----------+---------+-----------+------------+-----------+\n");
+    }
+
+    for (int c = 0; c < ncounts && thread_counts[c] <= max_threads; c++)
+        bench_mutex(thread_counts[c]);
+    for (int c = 0; c < ncounts && thread_counts[c] <= max_threads; c++)
+        if (thread_counts[c] >= 2)
+            bench_condvar(thread_counts[c]);
+    for (int c = 0; c < ncounts && thread_counts[c] <= max_threads; c++)
+        if (thread_counts[c] >= 2)
+            bench_barrier(thread_counts[c]);
+    for (int c = 0; c < ncounts && thread_counts[c] <= max_threads; c++)
+        bench_rwlock(thread_counts[c]);
+
+    if (!tsv_output) {
+        printf("  +----------+---------+-----------+------------+-----------+\n");
+        printf("\n");
+        printf("Compare against a native run: box64 ns/op minus native ns/op is\n");
+        printf("the wrapper + bridge cost per call pair.\n");
+    }
+    return 0;
+}
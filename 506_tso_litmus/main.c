@@ -0,0 +1,359 @@
+/*
+ * 506_tso_litmus
+ *
+ * Benchmark: x86 TSO ordering under box64's strongmem settings
+ *
+ * Background:
+ *   x86_64 is TSO: stores are not reordered with other stores, loads are
+ *   not reordered with other loads, and only a store followed by a load
+ *   to a different address may be reordered (the store buffer). Lock-free
+ *   code compiled for x86 relies on this with plain MOVs and no fences.
+ *   ARM64 is weakly ordered, so a plain MOV translated to a plain LDR/STR
+ *   can be observed out of order by another core. Box64 trades speed for
+ *   ordering with BOX64_DYNAREC_STRONGMEM (0 = fastest, up to 3 = most
+ *   barriers). MFENCE and LOCK-prefixed instructions are always fenced.
+ *
+ * Kernels (2 threads each, plain volatile accesses, compiler barriers
+ * only, so the x86 binary relies on TSO exactly like real lock-free code):
+ *   1. mp          - message passing: writer stores data then flag;
+ *                    reader loads flag then data. Violation: data older
+ *                    than flag (store-store or load-load reordered)
+ *   2. spsc        - single-producer/single-consumer ring: producer fills
+ *                    the slot then publishes head; consumer reads head then
+ *                    the slot. Violation: slot holds a stale sequence number
+ *   3. seqlock     - writer bumps seq, writes two words, bumps seq;
+ *                    reader retries on odd/changed seq. Violation: reader
+ *                    accepted a torn pair
+ *   4. dekker      - Peterson lock with MFENCE between the flag store and
+ *                    the other flag's load, guarding a plain counter.
+ *                    Violation: lost increments
+ *   5. dekker_nofence - same without MFENCE. TSO itself allows this to
+ *                    fail (store→load reordering); it is the positive
+ *                    control showing the harness can see violations
+ *
+ * Each kernel reports Mops/s and its violation count. Violations in 1-4
+ * mean the current setting does not preserve TSO for that pattern.
+ * Violations only show up with real parallelism: run on a multi-core host.
+ *
+ * Run:
+ *   ./506_tso_litmus [scale]
+ *   BOX64_DYNAREC_STRONGMEM=0 box64 ./506_tso_litmus
+ *   BOX64_DYNAREC_STRONGMEM=1 box64 ./506_tso_litmus
+ *   ... up to 3
+ *
+ *   scale multiplies the iteration counts (default 1).
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <time.h>
+
+/* Configuration */
+#define MP_MESSAGES       5000000  /* Writer stores per mp run */
+#define SPSC_ITEMS        5000000  /* Items through the ring */
+#define SPSC_RING_SIZE    1024     /* Slots, power of two */
+#define SEQLOCK_WRITES    2000000  /* Writer updates per seqlock run */
+#define DEKKER_INCREMENTS 500000   /* Increments per thread */
+#define SPINS_BEFORE_YIELD 256     /* Busy-wait spins before sched_yield() */
+
+/* Compiler barrier only: no hardware fence is emitted on any target */
+#define COMPILER_BARRIER() __asm__ volatile("" ::: "memory")
+
+/* Keep hot shared words on separate cache lines */
+#define CACHE_LINE 64
+#define PADDED(type, name) \
+    struct { volatile type v; char pad[CACHE_LINE - sizeof(type)]; } name \
+    __attribute__((aligned(CACHE_LINE)))
+
+static long scale = 1;
+static atomic_int start_flag = 0;
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void spin_wait(int *spins)
+{
+    if (++*spins >= SPINS_BEFORE_YIELD) {
+        *spins = 0;
+        sched_yield();
+    }
+}
+
+static void wait_start(void)
+{
+    int spins = 0;
+    while (!atomic_load(&start_flag))
+        spin_wait(&spins);
+}
+
+/*
+ * Run writer/reader on two threads, released together. Returns wall time
+ * from release until both have finished.
+ */
+static uint64_t run_pair(void *(*a)(void *), void *(*b)(void *))
+{
+    pthread_t ta, tb;
+    atomic_store(&start_flag, 0);
+    pthread_create(&ta, NULL, a, NULL);
+    pthread_create(&tb, NULL, b, NULL);
+    usleep(1000);
+    uint64_t t0 = now_ns();
+    atomic_store(&start_flag, 1);
+    pthread_join(ta, NULL);
+    pthread_join(tb, NULL);
+    return now_ns() - t0;
+}
+
+/* ── 1. Message passing ──────────────────────────────────────────── */
+
+static PADDED(long, mp_data);
+static PADDED(long, mp_flag);
+static long mp_violations, mp_reads;
+
+static void *mp_writer(void *arg)
+{
+    (void)arg;
+    wait_start();
+    for (long i = 1; i <= MP_MESSAGES * scale; i++) {
+        mp_data.v = i;
+        COMPILER_BARRIER();
+        mp_flag.v = i;
+    }
+    return NULL;
+}
+
+static void *mp_reader(void *arg)
+{
+    (void)arg;
+    long last = MP_MESSAGES * scale, reads = 0, bad = 0;
+    wait_start();
+    for (;;) {
+        long f = mp_flag.v;
+        COMPILER_BARRIER();
+        long d = mp_data.v;
+        reads++;
+        if (d < f)
+            bad++;
+        if (f == last)
+            break;
+    }
+    mp_reads = reads;
+    mp_violations = bad;
+    return NULL;
+}
+
+/* ── 2. SPSC ring ────────────────────────────────────────────────── */
+
+static volatile long spsc_ring[SPSC_RING_SIZE];
+static PADDED(long, spsc_head);   /* written by producer */
+static PADDED(long, spsc_tail);   /* written by consumer */
+static long spsc_violations;
+
+static void *spsc_producer(void *arg)
+{
+    (void)arg;
+    long n = SPSC_ITEMS * scale;
+    int spins = 0;
+    wait_start();
+    for (long seq = 0; seq < n; seq++) {
+        while (seq - spsc_tail.v >= SPSC_RING_SIZE)
+            spin_wait(&spins);
+        spsc_ring[seq & (SPSC_RING_SIZE - 1)] = seq;
+        COMPILER_BARRIER();
+        spsc_head.v = seq + 1;
+    }
+    return NULL;
+}
+
+static void *spsc_consumer(void *arg)
+{
+    (void)arg;
+    long n = SPSC_ITEMS * scale, bad = 0;
+    int spins = 0;
+    wait_start();
+    for (long seq = 0; seq < n; seq++) {
+        while (spsc_head.v <= seq)
+            spin_wait(&spins);
+        COMPILER_BARRIER();
+        if (spsc_ring[seq & (SPSC_RING_SIZE - 1)] != seq)
+            bad++;
+        COMPILER_BARRIER();
+        spsc_tail.v = seq + 1;
+    }
+    spsc_violations = bad;
+    return NULL;
+}
+
+/* ── 3. Seqlock ──────────────────────────────────────────────────── */
+
+static PADDED(long, sl_seq);
+static volatile long sl_a, sl_b;
+static atomic_int sl_done = 0;
+static long sl_violations, sl_reads;
+
+static void *seqlock_writer(void *arg)
+{
+    (void)arg;
+    wait_start();
+    for (long i = 1; i <= SEQLOCK_WRITES * scale; i++) {
+        sl_seq.v = sl_seq.v + 1;      /* odd: write in progress */
+        COMPILER_BARRIER();
+        sl_a = i;
+        sl_b = i;
+        COMPILER_BARRIER();
+        sl_seq.v = sl_seq.v + 1;      /* even: stable */
+    }
+    atomic_store(&sl_done, 1);
+    return NULL;
+}
+
+static void *seqlock_reader(void *arg)
+{
+    (void)arg;
+    long reads = 0, bad = 0;
+    int spins = 0;
+    wait_start();
+    while (!atomic_load_explicit(&sl_done, memory_order_relaxed)) {
+        long s1 = sl_seq.v;
+        if (s1 & 1) {
+            spin_wait(&spins);
+            continue;
+        }
+        COMPILER_BARRIER();
+        long a = sl_a;
+        long b = sl_b;
+        COMPILER_BARRIER();
+        if (sl_seq.v != s1)
+            continue;
+        reads++;
+        if (a != b)
+            bad++;
+    }
+    sl_reads = reads;
+    sl_violations = bad;
+    return NULL;
+}
+
+/* ── 4/5. Peterson lock (Dekker-style store→load) ────────────────── */
+
+static PADDED(int, pt_flag0);
+static PADDED(int, pt_flag1);
+static PADDED(int, pt_victim);
+static volatile long pt_counter;
+static int pt_use_fence;
+
+static inline void full_fence(void)
+{
+    if (pt_use_fence)
+        __sync_synchronize();   /* MFENCE on x86_64, DMB ISH on ARM64 */
+}
+
+static void peterson_loop(int me)
+{
+    volatile int *mine = me ? &pt_flag1.v : &pt_flag0.v;
+    volatile int *other = me ? &pt_flag0.v : &pt_flag1.v;
+    int spins = 0;
+
+    wait_start();
+    for (long i = 0; i < DEKKER_INCREMENTS * scale; i++) {
+        *mine = 1;
+        pt_victim.v = me;
+        full_fence();
+        while (*other && pt_victim.v == me)
+            spin_wait(&spins);
+        COMPILER_BARRIER();
+        pt_counter = pt_counter + 1;    /* critical section */
+        COMPILER_BARRIER();
+        *mine = 0;
+    }
+}
+
+static void *peterson_0(void *arg) { (void)arg; peterson_loop(0); return NULL; }
+static void *peterson_1(void *arg) { (void)arg; peterson_loop(1); return NULL; }
+
+/* ── Driver ──────────────────────────────────────────────────────── */
+
+static int tso_broken = 0;
+
+/*
+ * checks is how many times the reader side actually tested the invariant;
+ * 0 means the two threads never overlapped and the row proves nothing.
+ */
+static void report(const char *name, long ops, uint64_t ns, long checks,
+                   long violations, int tso_allows)
+{
+    const char *verdict = checks == 0 ? "no overlap"
+                        : violations == 0 ? "OK"
+                        : tso_allows ? "seen (TSO allows)" : "VIOLATED";
+    printf("  | %-15s | %10ld | %8.2f | %10ld | %-17s |\n",
+           name, ops, ops * 1e3 / (double)ns, violations, verdict);
+    if (violations && !tso_allows)
+        tso_broken = 1;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1)
+        scale = atol(argv[1]);
+    if (scale < 1)
+        scale = 1;
+
+    const char *strongmem = getenv("BOX64_DYNAREC_STRONGMEM");
+
+    printf("########################################\n");
+    printf(" BENCH 506: TSO litmus and throughput\n");
+    printf(" BOX64_DYNAREC_STRONGMEM=%s, online CPUs: %ld, scale %ld\n",
+           strongmem ? strongmem : "(unset)",
+           sysconf(_SC_NPROCESSORS_ONLN), scale);
+    printf("########################################\n\n");
+
+    printf("  +-----------------+------------+----------+------------+-------------------+\n");
+    printf("  | Kernel          |        Ops |   Mops/s | Violations | Verdict           |\n");
+    printf("  +-----------------+------------+----------+------------+-------------------+\n");
+
+    uint64_t ns = run_pair(mp_writer, mp_reader);
+    report("mp", MP_MESSAGES * scale, ns, mp_reads, mp_violations, 0);
+
+    ns = run_pair(spsc_producer, spsc_consumer);
+    report("spsc", SPSC_ITEMS * scale, ns, SPSC_ITEMS * scale, spsc_violations, 0);
+
+    ns = run_pair(seqlock_writer, seqlock_reader);
+    report("seqlock", SEQLOCK_WRITES * scale, ns, sl_reads, sl_violations, 0);
+
+    pt_use_fence = 1;
+    pt_counter = 0;
+    ns = run_pair(peterson_0, peterson_1);
+    report("dekker", 2 * DEKKER_INCREMENTS * scale, ns,
+           2 * DEKKER_INCREMENTS * scale,
+           2 * DEKKER_INCREMENTS * scale - pt_counter, 0);
+
+    pt_use_fence = 0;
+    pt_counter = 0;
+    ns = run_pair(peterson_0, peterson_1);
+    report("dekker_nofence", 2 * DEKKER_INCREMENTS * scale, ns,
+           2 * DEKKER_INCREMENTS * scale,
+           2 * DEKKER_INCREMENTS * scale - pt_counter, 1);
+
+    printf("  +-----------------+------------+----------+------------+-------------------+\n");
+    printf("\n");
+    printf("Ops: mp/seqlock = writer updates, spsc = items, dekker = increments.\n");
+    if (sysconf(_SC_NPROCESSORS_ONLN) < 2)
+        printf("Single CPU: reorderings cannot be observed, all kernels read OK.\n");
+    if (tso_broken)
+        printf("RESULT: TSO ordering NOT preserved at this setting.\n");
+    else
+        printf("RESULT: no TSO violations observed.\n");
+
+    return tso_broken;
+}
@@ -0,0 +1,427 @@
+/*
+ * 507_startup_code_cache
+ *
+ * Benchmark: startup time with a cold and a warm dynarec code cache
+ *
+ * Background:
+ *   Every box64 process starts with an empty code cache: each x86 block
+ *   that runs is translated again, run after run, even when the binary
+ *   and its libraries have not changed. For short-lived processes (build
+ *   tools, shell scripts, test suites) that translation work dominates:
+ *   the program is done before it ever reaches steady state.
+ *
+ *   A persistent code cache saves the translated blocks of a mapping to
+ *   disk (keyed by the ELF build-id and the mapping offset, with enough
+ *   relocation data to patch absolute addresses on reload) and maps them
+ *   back in on the next run. box64 ships such a cache: BOX64_DYNACACHE=1
+ *   writes and reuses it, BOX64_DYNACACHE_FOLDER says where, and
+ *   BOX64_DYNACACHE_MIN (KB, 350 by default) skips smaller mappings.
+ *   This benchmark measures what it buys.
+ *
+ * What is measured:
+ *   The benchmark re-executes itself as a child (argv[0] --child), so
+ *   under box64 the child is a fresh box64 process with the same
+ *   environment. The child runs NUM_ROUNDS rounds over NUM_FUNCS distinct
+ *   small functions (each a few blocks). Round 0 pays for translating
+ *   all of them; later rounds run from the code cache.
+ *
+ *     time-to-main    fork() in the parent -> first line of the child's
+ *                     main(): exec, box64 init, ELF loading, libc init
+ *     steady round    median duration of the second half of the rounds
+ *     time-to-steady  fork() -> end of the first round no slower than
+ *                     STEADY_FACTOR x steady round
+ *
+ *   Timestamps are CLOCK_MONOTONIC, which is system-wide, so parent and
+ *   child timestamps can be subtracted.
+ *
+ * Scenarios:
+ *   1. cold - the cache directory is emptied before every run
+ *   2. warm - one unmeasured run fills the cache, then RUNS measured runs
+ *
+ *   With a cache_dir argument, the children get BOX64_DYNACACHE=1,
+ *   BOX64_DYNACACHE_FOLDER=cache_dir and BOX64_DYNACACHE_MIN=0 (the test
+ *   binary is far below 350 KB of code). Without one they get
+ *   BOX64_DYNACACHE=0, so both scenarios run the same way and the
+ *   difference between them is noise: the baseline.
+ *
+ * Check:
+ *   With a cache_dir, the run that fills the cache for the warm runs must
+ *   leave at least one file in it. The test fails under box64 when it
+ *   does not: the cache was not written. Native runs write nothing and
+ *   only report it.
+ *
+ * Run:
+ *   ./507_startup_code_cache [runs] [cache_dir]
+ *   BOX64_DYNAREC=1 box64 ./507_startup_code_cache
+ *   BOX64_DYNAREC=1 box64 ./507_startup_code_cache 5 /tmp/dc
+ *
+ *   Default: 5 runs per scenario. Everything below cache_dir is deleted
+ *   before the cold runs and before priming the warm runs.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/wait.h>
+
+/* Configuration */
+#define DEFAULT_RUNS      5     /* Measured runs per scenario */
+#define MAX_RUNS          64
+#define NUM_FUNCS         1024  /* Generated functions (4^5) */
+#define CALLS_PER_ROUND   16    /* Calls to each function per round */
+#define NUM_ROUNDS        40
+#define STEADY_FACTOR     1.25  /* Round counts as steady within this */
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* ── Generated workload ──────────────────────────────────────────── */
+
+/*
+ * NUM_FUNCS distinct functions fn_100000 .. fn_133333 (ids are base-4
+ * digits after a leading 1). Each has a branch, so the dynarec sees a
+ * few blocks per function; the constants keep them from being merged.
+ */
+#define GEN_FUNC(n)                                 \
+    __attribute__((noinline))                       \
+    static long fn_##n(long x)                      \
+    {                                               \
+        if (x & 1)                                  \
+            x = x * (n) + 0x##n;                    \
+        else                                        \
+            x ^= (x >> 3) + (n);                    \
+        return x + ((n) & 0xff);                    \
+    }
+#define GEN_PTR(n) fn_##n,
+
+#define L0(X, p) X(p##0) X(p##1) X(p##2) X(p##3)
+#define L1(X, p) L0(X, p##0) L0(X, p##1) L0(X, p##2) L0(X, p##3)
+#define L2(X, p) L1(X, p##0) L1(X, p##1) L1(X, p##2) L1(X, p##3)
+#define L3(X, p) L2(X, p##0) L2(X, p##1) L2(X, p##2) L2(X, p##3)
+#define L4(X, p) L3(X, p##0) L3(X, p##1) L3(X, p##2) L3(X, p##3)
+
+L4(GEN_FUNC, 1)
+
+typedef long (*gen_func_t)(long);
+static gen_func_t funcs[NUM_FUNCS] = { L4(GEN_PTR, 1) };
+
+/* ── Child ───────────────────────────────────────────────────────── */
+
+typedef struct {
+    uint64_t main_ns;                 /* first timestamp in main() */
+    uint64_t round_end_ns[NUM_ROUNDS];
+    uint64_t round_ns[NUM_ROUNDS];
+    long sink;
+} child_result_t;
+
+static int child_main(int fd, uint64_t main_ns)
+{
+    child_result_t r;
+    long x = 1;
+
+    memset(&r, 0, sizeof(r));
+    r.main_ns = main_ns;
+    for (int round = 0; round < NUM_ROUNDS; round++) {
+        uint64_t t0 = now_ns();
+        for (int c = 0; c < CALLS_PER_ROUND; c++)
+            for (int f = 0; f < NUM_FUNCS; f++)
+                x = funcs[f](x + c);
+        uint64_t t1 = now_ns();
+        r.round_ns[round] = t1 - t0;
+        r.round_end_ns[round] = t1;
+    }
+    r.sink = x;
+
+    if (write(fd, &r, sizeof(r)) != (ssize_t)sizeof(r))
+        return 1;
+    close(fd);
+    return 0;
+}
+
+/* ── Parent ──────────────────────────────────────────────────────── */
+
+typedef struct {
+    double to_main_ms;
+    double first_round_ms;
+    double steady_round_ms;
+    double to_steady_ms;
+    int steady_round;
+} run_result_t;
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static int unlink_entry(const char *path, const struct stat *sb, int type, struct FTW *ftw)
+{
+    (void)sb;
+    if (ftw->level == 0)
+        return 0;
+    if ((type == FTW_DP ? rmdir(path) : unlink(path)) != 0)
+        perror(path);
+    return 0;
+}
+
+static void clear_cache_dir(const char *dir)
+{
+    if (nftw(dir, unlink_entry, 16, FTW_DEPTH | FTW_PHYS) != 0 && errno != ENOENT)
+        perror(dir);
+}
+
+static int cache_files;
+static long long cache_bytes;
+
+static int count_entry(const char *path, const struct stat *sb, int type, struct FTW *ftw)
+{
+    (void)path;
+    (void)ftw;
+    if (type == FTW_F) {
+        cache_files++;
+        cache_bytes += sb->st_size;
+    }
+    return 0;
+}
+
+/* Regular files below dir; their total size goes to cache_bytes */
+static int count_cache_files(const char *dir)
+{
+    cache_files = 0;
+    cache_bytes = 0;
+    nftw(dir, count_entry, 16, FTW_PHYS);
+    return cache_files;
+}
+
+/* The children inherit this: the cache in cache_dir, or no cache at all */
+static void set_cache_env(const char *cache_dir)
+{
+    if (!cache_dir) {
+        setenv("BOX64_DYNACACHE", "0", 1);
+        return;
+    }
+    setenv("BOX64_DYNACACHE", "1", 1);
+    setenv("BOX64_DYNACACHE_FOLDER", cache_dir, 1);
+    setenv("BOX64_DYNACACHE_MIN", "0", 1);
+}
+
+/* box64 maps itself into the process it emulates */
+static int under_box64(void)
+{
+    FILE *f = fopen("/proc/self/maps", "r");
+    char line[512];
+    int found = 0;
+    if (!f)
+        return 0;
+    while (!found && fgets(line, sizeof(line), f)) {
+        char *slash = strrchr(line, '/');
+        found = slash && strncmp(slash, "/box64", 6) == 0;
+    }
+    fclose(f);
+    return found;
+}
+
+/* Run one child and derive the startup numbers. Returns -1 on failure. */
+static int run_child(const char *self, run_result_t *out)
+{
+    int pfd[2];
+    char fdarg[16];
+    child_result_t r;
+
+    if (pipe(pfd) != 0) {
+        perror("pipe");
+        return -1;
+    }
+    snprintf(fdarg, sizeof(fdarg), "%d", pfd[1]);
+
+    uint64_t t_fork = now_ns();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        close(pfd[0]);
+        execlp(self, self, "--child", fdarg, (char *)NULL);
+        perror(self);
+        _exit(127);
+    }
+    close(pfd[1]);
+
+    size_t got = 0;
+    while (got < sizeof(r)) {
+        ssize_t n = read(pfd[0], (char *)&r + got, sizeof(r) - got);
+        if (n <= 0)
+            break;
+        got += n;
+    }
+    close(pfd[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    if (got != sizeof(r) || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "child failed (status 0x%x, %zu bytes)\n", status, got);
+        return -1;
+    }
+
+    uint64_t tail[NUM_ROUNDS];
+    int ntail = NUM_ROUNDS - NUM_ROUNDS / 2;
+    memcpy(tail, &r.round_ns[NUM_ROUNDS / 2], ntail * sizeof(tail[0]));
+    qsort(tail, ntail, sizeof(tail[0]), cmp_u64);
+    uint64_t steady = tail[ntail / 2];
+
+    int s = 0;
+    while (s < NUM_ROUNDS - 1 && r.round_ns[s] > steady * STEADY_FACTOR)
+        s++;
+
+    out->to_main_ms = (r.main_ns - t_fork) / 1e6;
+    out->first_round_ms = r.round_ns[0] / 1e6;
+    out->steady_round_ms = steady / 1e6;
+    out->to_steady_ms = (r.round_end_ns[s] - t_fork) / 1e6;
+    out->steady_round = s;
+    return 0;
+}
+
+static double median(double *v, int n)
+{
+    qsort(v, n, sizeof(v[0]), cmp_double);
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+static void print_separator(void)
+{
+    printf("  +----------+-----+-------------+-------------+-------------+--------+--------------+\n");
+}
+
+/*
+ * Run one scenario; fills the per-metric medians, and *primed with the
+ * files the priming run of a warm scenario left. Returns failed runs.
+ */
+static int run_scenario(const char *name, const char *self, const char *cache_dir,
+                        int warm, int runs, run_result_t *med, int *primed)
+{
+    double to_main[MAX_RUNS], first[MAX_RUNS], steady[MAX_RUNS], to_steady[MAX_RUNS];
+    int ok = 0, failed = 0;
+
+    if (cache_dir)
+        clear_cache_dir(cache_dir);
+    if (warm) {
+        run_result_t prime;
+        if (run_child(self, &prime) != 0)
+            failed++;
+        if (cache_dir)
+            *primed = count_cache_files(cache_dir);
+    }
+
+    for (int i = 0; i < runs; i++) {
+        run_result_t r;
+        if (!warm && cache_dir && i > 0)
+            clear_cache_dir(cache_dir);
+        if (run_child(self, &r) != 0) {
+            failed++;
+            continue;
+        }
+        printf("  | %-8s | %3d | %11.2f | %11.2f | %11.3f | %6d | %12.2f |\n",
+               name, i, r.to_main_ms, r.first_round_ms, r.steady_round_ms,
+               r.steady_round, r.to_steady_ms);
+        to_main[ok] = r.to_main_ms;
+        first[ok] = r.first_round_ms;
+        steady[ok] = r.steady_round_ms;
+        to_steady[ok] = r.to_steady_ms;
+        ok++;
+    }
+
+    memset(med, 0, sizeof(*med));
+    if (ok) {
+        med->to_main_ms = median(to_main, ok);
+        med->first_round_ms = median(first, ok);
+        med->steady_round_ms = median(steady, ok);
+        med->to_steady_ms = median(to_steady, ok);
+    }
+    return failed;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc == 3 && strcmp(argv[1], "--child") == 0) {
+        uint64_t main_ns = now_ns();
+        return child_main(atoi(argv[2]), main_ns);
+    }
+
+    int runs = argc > 1 ? atoi(argv[1]) : DEFAULT_RUNS;
+    const char *cache_dir = argc > 2 ? argv[2] : NULL;
+    if (runs < 1)
+        runs = DEFAULT_RUNS;
+    if (runs > MAX_RUNS)
+        runs = MAX_RUNS;
+
+    printf("########################################\n");
+    printf(" BENCHMARK 507: startup with a cold and warm code cache\n");
+    printf("########################################\n\n");
+    printf("Workload: %d functions x %d calls per round, %d rounds, %d runs per scenario\n",
+           NUM_FUNCS, CALLS_PER_ROUND, NUM_ROUNDS, runs);
+    if (cache_dir)
+        printf("Cache directory: %s (emptied for cold runs), BOX64_DYNACACHE=1\n\n", cache_dir);
+    else
+        printf("No cache directory: BOX64_DYNACACHE=0, cold and warm runs are the same (baseline)\n\n");
+    set_cache_env(cache_dir);
+
+    run_result_t cold, warm;
+    int failed = 0, primed = 0;
+
+    print_separator();
+    printf("  | Cache    | Run | to-main ms  | round 0 ms  | steady ms   | steady | to-steady ms |\n");
+    print_separator();
+    failed += run_scenario("cold", argv[0], cache_dir, 0, runs, &cold, &primed);
+    failed += run_scenario("warm", argv[0], cache_dir, 1, runs, &warm, &primed);
+    print_separator();
+    if (cache_dir)
+        printf("\nCache after the priming run: %d files, %lld bytes\n", primed, cache_bytes);
+
+    printf("\nMedians:\n");
+    printf("  +----------------+-------------+-------------+---------+\n");
+    printf("  | Metric         |   cold (ms) |   warm (ms) | speedup |\n");
+    printf("  +----------------+-------------+-------------+---------+\n");
+    struct { const char *name; double c, w; } rows[] = {
+        { "time-to-main",   cold.to_main_ms,      warm.to_main_ms },
+        { "round 0",        cold.first_round_ms,  warm.first_round_ms },
+        { "steady round",   cold.steady_round_ms, warm.steady_round_ms },
+        { "time-to-steady", cold.to_steady_ms,    warm.to_steady_ms },
+    };
+    for (size_t i = 0; i < sizeof(rows) / sizeof(rows[0]); i++)
+        printf("  | %-14s | %11.3f | %11.3f | %6.2fx |\n", rows[i].name,
+               rows[i].c, rows[i].w, rows[i].w > 0 ? rows[i].c / rows[i].w : 0.0);
+    printf("  +----------------+-------------+-------------+---------+\n\n");
+
+    printf("steady = first round within %.2fx of the steady round time.\n", STEADY_FACTOR);
+    printf("round 0 / steady round shows the translation cost a warm cache removes.\n");
+    if (failed) {
+        printf("\nFAIL: %d child runs failed\n", failed);
+        return 1;
+    }
+    if (cache_dir && !primed) {
+        if (under_box64()) {
+            printf("\nFAIL: box64 wrote no cache file to %s\n", cache_dir);
+            return 1;
+        }
+        printf("\nNative run: nothing writes the cache, warm runs are a second baseline\n");
+    }
+    return 0;
+}
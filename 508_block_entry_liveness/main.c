@@ -0,0 +1,334 @@
+/*
+ * 508_block_entry_liveness
+ *
+ * Benchmark: cost of dynablock liveness tracking on block entry, and
+ * how much of the inherited code cache a forked child can purge
+ *
+ * Background:
+ *   box64 keeps a dynablock alive while a thread runs it with the
+ *   per-block in_used counter: EmuRun() increments it when it enters the
+ *   block and decrements it when the block returns to the dispatch loop.
+ *   Threads entering the same block all write the same cache line. After fork() the child inherits the counts of threads
+ *   that do not exist there, and those blocks can never be purged
+ *   (test 001). patches/dynarec_epoch_liveness.patch replaces the counter
+ *   with per-thread epochs: entry writes only the thread's own slot, and
+ *   the child releases the slots of the threads it lost.
+ *
+ * Part 1 - block entry overhead:
+ *   T threads (1, 2, 4, ... MAX_THREADS, at most the online CPUs) each
+ *   make calls_per_thread indirect calls to a tiny function. Compiled
+ *   calls chain through the jump table and skip EmuRun(), so only the
+ *   first call of a thread (or one to a block not in the table) touches
+ *   in_used or the epoch slot.
+ *     shared  - every thread calls the same function (same dynablock)
+ *     private - thread i calls its own copy (one dynablock per thread)
+ *   Reported as ns per call per thread. shared/private isolates the cost
+ *   of running one block from several threads: ~1.0 when the chained
+ *   path writes nothing shared, with or without the epoch patch.
+ *
+ * Part 2 - purgeability in a forked child (001's setup):
+ *   NUM_WORKERS threads spin in hot_compute_0..3, the main thread forks,
+ *   and the child calls box64_purge() (common/box64ctl.h), which
+ *   invalidates every block nobody holds. It then runs a function that
+ *   was never compiled, so it passes through the dispatch loop and
+ *   deferred frees can happen, and calls box64_purge() again to free the
+ *   blocks the first call queued.
+ *   Reported: done/pinned blocks and code cache bytes before the purge,
+ *   after each call, and the fraction of the inherited blocks
+ *   invalidated and of the cache bytes released.
+ *   SKIP when libbox64ctl is not answered by box64.
+ *
+ * Run:
+ *   ./508_block_entry_liveness [calls_per_thread]
+ *   BOX64_DYNAREC=1 box64 ./508_block_entry_liveness
+ *
+ *   Default: 20000000 calls per thread. Run once with a stock box64 and
+ *   once with the epoch patch applied.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "../common/box64ctl.h"
+
+/* Configuration */
+#define DEFAULT_CALLS     20000000  /* Indirect calls per thread */
+#define MAX_THREADS       8         /* Part 1 thread counts: 1, 2, 4, 8 */
+#define NUM_WORKERS       8         /* Part 2 threads inside hot blocks */
+#define NUM_HOT_FUNCS     4         /* Same hot functions as 001 */
+#define COMPILE_WAIT_MS   300       /* Time for the dynarec to compile */
+#define SETTLE_CALLS      1000      /* Calls after the purge, see part 2 */
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* ── Part 1: block entry ─────────────────────────────────────────── */
+
+/*
+ * MAX_THREADS copies of the same tiny body, so "private" gives each
+ * thread its own block. tiny_0 doubles as the "shared" function.
+ */
+#define TINY_FUNC(n)                                \
+    __attribute__((noinline))                       \
+    static long tiny_##n(long x)                    \
+    {                                               \
+        return x * 3 + (n);                         \
+    }
+
+TINY_FUNC(0) TINY_FUNC(1) TINY_FUNC(2) TINY_FUNC(3)
+TINY_FUNC(4) TINY_FUNC(5) TINY_FUNC(6) TINY_FUNC(7)
+
+typedef long (*tiny_func_t)(long);
+static tiny_func_t tiny_funcs[MAX_THREADS] = {
+    tiny_0, tiny_1, tiny_2, tiny_3, tiny_4, tiny_5, tiny_6, tiny_7
+};
+
+typedef struct {
+    pthread_barrier_t *start;
+    tiny_func_t func;
+    long calls;
+    long sink;
+} tiny_arg_t;
+
+static void *tiny_worker(void *p)
+{
+    tiny_arg_t *a = p;
+    /* volatile: one real indirect call per iteration */
+    tiny_func_t volatile f = a->func;
+    long x = 1;
+
+    pthread_barrier_wait(a->start);
+    for (long i = 0; i < a->calls; i++)
+        x = f(x);
+    a->sink = x;
+    return NULL;
+}
+
+/* ns per call per thread */
+static double run_entry(int nthreads, int shared, long calls)
+{
+    pthread_t th[MAX_THREADS];
+    tiny_arg_t args[MAX_THREADS];
+    pthread_barrier_t start;
+
+    pthread_barrier_init(&start, NULL, nthreads + 1);
+    for (int i = 0; i < nthreads; i++) {
+        args[i].start = &start;
+        args[i].func = tiny_funcs[shared ? 0 : i];
+        args[i].calls = calls;
+        pthread_create(&th[i], NULL, tiny_worker, &args[i]);
+    }
+    pthread_barrier_wait(&start);
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < nthreads; i++)
+        pthread_join(th[i], NULL);
+    uint64_t t1 = now_ns();
+    pthread_barrier_destroy(&start);
+
+    return (double)(t1 - t0) / calls;
+}
+
+static void run_part1(long calls)
+{
+    printf("Part 1: block entry, %ld indirect calls per thread\n\n", calls);
+    printf("  +---------+----------------+-----------------+----------------+\n");
+    printf("  | Threads | shared ns/call | private ns/call | shared/private |\n");
+    printf("  +---------+----------------+-----------------+----------------+\n");
+
+    /* warm-up: compile every tiny function before timing */
+    run_entry(MAX_THREADS, 0, 100000);
+
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int t = 1; t <= MAX_THREADS && t <= ncpu; t *= 2) {
+        double s = run_entry(t, 1, calls);
+        double p = run_entry(t, 0, calls);
+        printf("  | %7d | %14.2f | %15.2f | %13.2fx |\n", t, s, p, p > 0 ? s / p : 0.0);
+    }
+    printf("  +---------+----------------+-----------------+----------------+\n");
+    printf("  Thread counts above the %ld online CPUs are skipped.\n\n", ncpu);
+}
+
+/* ── Part 2: purgeability after fork ─────────────────────────────── */
+
+static atomic_int stop_workers = 0;
+static atomic_int workers_ready = 0;
+
+__attribute__((noinline, optimize("O2")))
+long hot_compute_0(long iterations) {
+    long sum = 0;
+    for (long i = 0; i < iterations; i++) {
+        sum += i * i;
+        if ((i & 0x3FFFF) == 0 && atomic_load(&stop_workers))
+            return sum;
+    }
+    return sum;
+}
+
+__attribute__((noinline, optimize("O2")))
+long hot_compute_1(long iterations) {
+    long sum = 0;
+    for (long i = 0; i < iterations; i++) {
+        sum += i * (i + 1);
+        if ((i & 0x3FFFF) == 0 && atomic_load(&stop_workers))
+            return sum;
+    }
+    return sum;
+}
+
+__attribute__((noinline, optimize("O2")))
+long hot_compute_2(long iterations) {
+    long sum = 0;
+    for (long i = 0; i < iterations; i++) {
+        sum += (i << 1) ^ i;
+        if ((i & 0x3FFFF) == 0 && atomic_load(&stop_workers))
+            return sum;
+    }
+    return sum;
+}
+
+__attribute__((noinline, optimize("O2")))
+long hot_compute_3(long iterations) {
+    long sum = 0;
+    for (long i = 0; i < iterations; i++) {
+        sum += i + (i & 0xFF);
+        if ((i & 0x3FFFF) == 0 && atomic_load(&stop_workers))
+            return sum;
+    }
+    return sum;
+}
+
+typedef long (*hot_func_t)(long);
+static hot_func_t hot_functions[NUM_HOT_FUNCS] = {
+    hot_compute_0,
+    hot_compute_1,
+    hot_compute_2,
+    hot_compute_3
+};
+
+/* Only ever called in the child: its first call compiles a new block */
+__attribute__((noinline))
+static long settle_func(long x)
+{
+    return (x ^ 0x5bd1e995) * 7;
+}
+
+static void *hot_worker(void *arg)
+{
+    hot_func_t f = hot_functions[(long)arg % NUM_HOT_FUNCS];
+    long sink = 0;
+    atomic_fetch_add(&workers_ready, 1);
+    while (!atomic_load(&stop_workers))
+        sink += f(50000000);
+    return (void *)sink;
+}
+
+static void print_counters(const char *when, const box64ctl_stats_t *s)
+{
+    printf("  | %-14s | %11llu | %13llu | %11llu | %11llu |\n", when,
+           (unsigned long long)s->done_blocks, (unsigned long long)s->pinned_blocks,
+           (unsigned long long)s->in_used_sum, (unsigned long long)s->alloc_bytes);
+}
+
+static int child_purge(void)
+{
+    box64ctl_stats_t before, purged, freed;
+    long x = 1;
+
+    box64ctl_stats(&before);
+    uint64_t t0 = now_ns();
+    int n = box64ctl_purge();
+    uint64_t t1 = now_ns();
+    box64ctl_stats(&purged);
+
+    tiny_func_t volatile f = settle_func;
+    for (int i = 0; i < SETTLE_CALLS; i++)
+        x = f(x);
+
+    /* The first call only invalidated: the second frees what it queued */
+    box64ctl_purge();
+    box64ctl_stats(&freed);
+
+    printf("  box64_purge(): %d blocks invalidated in %.1f us\n\n", n, (t1 - t0) / 1e3);
+    printf("  +----------------+-------------+---------------+-------------+-------------+\n");
+    printf("  | Counters       | done_blocks | pinned_blocks | in_used_sum | alloc_bytes |\n");
+    printf("  +----------------+-------------+---------------+-------------+-------------+\n");
+    print_counters("before purge", &before);
+    print_counters("after purge 1", &purged);
+    print_counters("after purge 2", &freed);
+    printf("  +----------------+-------------+---------------+-------------+-------------+\n\n");
+
+    double invalidated = before.done_blocks
+        ? 100.0 * n / before.done_blocks : 0.0;
+    /* settle_func and the code around it add a few blocks back */
+    double released = before.alloc_bytes > freed.alloc_bytes
+        ? 100.0 * (before.alloc_bytes - freed.alloc_bytes) / before.alloc_bytes : 0.0;
+    printf("  Invalidated %.1f%% of the %llu inherited blocks, released %.1f%% of the\n",
+           invalidated, (unsigned long long)before.done_blocks, released);
+    printf("  code cache, %llu still pinned (sink %ld)\n",
+           (unsigned long long)freed.pinned_blocks, x);
+    return 0;
+}
+
+static int run_part2(void)
+{
+    pthread_t workers[NUM_WORKERS];
+
+    printf("Part 2: purge in a child forked with %d threads in hot blocks\n\n", NUM_WORKERS);
+    if (!box64ctl_available()) {
+        printf("  SKIP: libbox64ctl not answered (native run, or box64 without\n");
+        printf("  patches/box64ctl_wrapped_lib.patch)\n");
+        return 0;
+    }
+
+    for (long i = 0; i < NUM_WORKERS; i++)
+        pthread_create(&workers[i], NULL, hot_worker, (void *)i);
+    while (atomic_load(&workers_ready) < NUM_WORKERS)
+        usleep(1000);
+    usleep(COMPILE_WAIT_MS * 1000);
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        int rc = child_purge();
+        fflush(stdout);
+        _exit(rc);
+    }
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    atomic_store(&stop_workers, 1);
+    for (int i = 0; i < NUM_WORKERS; i++)
+        pthread_join(workers[i], NULL);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("  child failed (status 0x%x)\n", status);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    long calls = argc > 1 ? atol(argv[1]) : DEFAULT_CALLS;
+    if (calls < 1)
+        calls = DEFAULT_CALLS;
+
+    printf("########################################\n");
+    printf(" BENCHMARK 508: block entry liveness cost and child purgeability\n");
+    printf("########################################\n\n");
+
+    run_part1(calls);
+    return run_part2();
+}
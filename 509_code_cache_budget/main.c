@@ -0,0 +1,276 @@
+/*
+ * 509_code_cache_budget
+ *
+ * Benchmark: throughput and recompile rate when the hot code does not
+ * fit in a capped dynarec code cache
+ *
+ * Background:
+ *   With patches/dynarec_cache_budget.patch, BOX64_DYNAREC_CACHE_MAX
+ *   caps the code cache: above the budget a CLOCK sweep (approximate
+ *   LRU, second chance on the accessed byte) evicts blocks, and an
+ *   evicted block is compiled again the next time it runs. Once the
+ *   working set is larger than the budget, every pass over it recompiles
+ *   part of it; how much depends on the access pattern and on how well
+ *   the sweep guesses what is hot.
+ *
+ * What this benchmark does:
+ *   NUM_FUNCS generated functions (a few blocks each) are the code. The
+ *   working set is the first W of them, with W sized at 0.5x, 1x, 2x and
+ *   4x the budget (read from BOX64_DYNAREC_CACHE_MAX, same syntax as
+ *   box64: bytes or a K/M/G suffix). The code cache bytes per function
+ *   come from box64_stats() when libbox64ctl is answered, otherwise
+ *   DEFAULT_FUNC_BYTES is assumed. For each W and access pattern
+ *     loop   - W functions in order, over and over (LRU's worst case)
+ *     random - uniform random picks among the W functions
+ *   it runs RUN_MS of calls. The blocks evicted during the row come from
+ *   the patch's cache_evicted_blocks counter in the stats dump
+ *   (common/box64_stats.h, needs BOX64_DYNAREC_STATS); each one is
+ *   compiled again when it is next reached. Every call is also timed,
+ *   and a call slower than SLOW_NS counts as slow: most of those went
+ *   through the compiler.
+ *
+ *   Reported per row: calls/s, blocks evicted per second, slow calls per
+ *   second and their share of calls, and the code cache size at the end
+ *   of the row (box64_stats()).
+ *
+ * Run:
+ *   ./509_code_cache_budget [run_ms]
+ *   BOX64_DYNAREC=1 BOX64_DYNAREC_CACHE_MAX=256K \
+ *   BOX64_DYNAREC_STATS=/tmp/box64_stats.%p.json box64 ./509_code_cache_budget
+ *
+ *   Default: 500 ms per row. Without BOX64_DYNAREC_CACHE_MAX the working
+ *   sets are sized from DEFAULT_BUDGET, and nothing is evicted.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+
+#include "../common/box64ctl.h"
+#include "../common/box64_stats.h"
+
+/* Configuration */
+#define NUM_FUNCS          1024          /* Generated functions (4^5) */
+#define DEFAULT_BUDGET     (256 << 10)   /* When BOX64_DYNAREC_CACHE_MAX is unset */
+#define DEFAULT_FUNC_BYTES 1024          /* When box64_stats() is not answered */
+#define PROBE_FUNCS        256           /* Functions compiled to measure bytes/function */
+#define DEFAULT_RUN_MS     500           /* Time per row */
+#define SLOW_NS            10000         /* Slower calls count as slow */
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* ── Generated code ──────────────────────────────────────────────── */
+
+/*
+ * NUM_FUNCS distinct functions fn_100000 .. fn_133333 (ids are base-4
+ * digits after a leading 1), two branches each, so a few blocks apiece.
+ */
+#define GEN_FUNC(n)                                 \
+    __attribute__((noinline))                       \
+    static long fn_##n(long x)                      \
+    {                                               \
+        if (x & 1)                                  \
+            x = x * (n) + 0x##n;                    \
+        else                                        \
+            x ^= (x >> 3) + (n);                    \
+        if (x & 2)                                  \
+            x += (x << 2) ^ (n);                    \
+        else                                        \
+            x -= (n) >> 1;                          \
+        return x + ((n) & 0xff);                    \
+    }
+#define GEN_PTR(n) fn_##n,
+
+#define L0(X, p) X(p##0) X(p##1) X(p##2) X(p##3)
+#define L1(X, p) L0(X, p##0) L0(X, p##1) L0(X, p##2) L0(X, p##3)
+#define L2(X, p) L1(X, p##0) L1(X, p##1) L1(X, p##2) L1(X, p##3)
+#define L3(X, p) L2(X, p##0) L2(X, p##1) L2(X, p##2) L2(X, p##3)
+#define L4(X, p) L3(X, p##0) L3(X, p##1) L3(X, p##2) L3(X, p##3)
+
+L4(GEN_FUNC, 1)
+
+typedef long (*gen_func_t)(long);
+static gen_func_t funcs[NUM_FUNCS] = { L4(GEN_PTR, 1) };
+
+/* ── Measurement ─────────────────────────────────────────────────── */
+
+typedef struct {
+    uint64_t calls;
+    uint64_t slow;
+    uint64_t ns;
+    long evicted;               /* -1 without the stats dump */
+    long sink;
+} row_result_t;
+
+/*
+ * Same parser as the patch: bytes, or a K/M/G suffix. 0 for anything
+ * else, and for a size that does not fit in a size_t.
+ */
+static size_t parse_size(const char *s)
+{
+    char *e;
+    int shift = 0;
+
+    if (strchr(s, '-'))
+        return 0;
+    errno = 0;
+    unsigned long long v = strtoull(s, &e, 0);
+    switch (*e) {
+    case 'g': case 'G': shift = 30; e++; break;
+    case 'm': case 'M': shift = 20; e++; break;
+    case 'k': case 'K': shift = 10; e++; break;
+    }
+    if (errno || *e || v > (SIZE_MAX >> shift))
+        return 0;
+    return (size_t)v << shift;
+}
+
+static inline uint32_t xorshift32(uint32_t *s)
+{
+    uint32_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *s = x;
+}
+
+static void run_row(int ws, int random_order, int run_ms, row_result_t *r)
+{
+    uint32_t rng = 2463534242u;
+    long x = 1;
+    int next = 0;
+
+    memset(r, 0, sizeof(*r));
+    /* one unmeasured pass: the working set has been compiled once */
+    for (int i = 0; i < ws; i++)
+        x = funcs[i](x);
+
+    char *before = box64_stats_enabled() ? box64_stats_snapshot() : NULL;
+    uint64_t start = now_ns(), deadline = start + (uint64_t)run_ms * 1000000ULL;
+    uint64_t t0 = start, t1 = start;
+    while (t1 < deadline) {
+        /* a batch of calls between deadline checks */
+        for (int b = 0; b < 256; b++) {
+            int f;
+            if (random_order)
+                f = xorshift32(&rng) % ws;
+            else {
+                f = next;
+                next = next + 1 == ws ? 0 : next + 1;
+            }
+            x = funcs[f](x);
+            t1 = now_ns();
+            if (t1 - t0 > SLOW_NS)
+                r->slow++;
+            t0 = t1;
+        }
+        r->calls += 256;
+    }
+    r->ns = t1 - start;
+    r->sink = x;
+
+    char *after = before ? box64_stats_snapshot() : NULL;
+    long b = box64_stats_get(before, "cache_evicted_blocks");
+    long a = box64_stats_get(after, "cache_evicted_blocks");
+    r->evicted = (b >= 0 && a >= b) ? a - b : -1;
+    free(before);
+    free(after);
+}
+
+/* Code cache bytes per generated function, from box64_stats() */
+static size_t measure_func_bytes(void)
+{
+    box64ctl_stats_t before, after;
+    long x = 1;
+
+    if (box64ctl_stats(&before) != 0)
+        return 0;
+    /* the last PROBE_FUNCS functions: not compiled by anything else yet */
+    for (int i = NUM_FUNCS - PROBE_FUNCS; i < NUM_FUNCS; i++)
+        x = funcs[i](x);
+    if (box64ctl_stats(&after) != 0 || after.alloc_bytes <= before.alloc_bytes)
+        return 0;
+    return (after.alloc_bytes - before.alloc_bytes + (x & 1)) / PROBE_FUNCS;
+}
+
+int main(int argc, char *argv[])
+{
+    static const double ratios[] = { 0.5, 1.0, 2.0, 4.0 };
+    int run_ms = argc > 1 ? atoi(argv[1]) : DEFAULT_RUN_MS;
+    if (run_ms < 1)
+        run_ms = DEFAULT_RUN_MS;
+
+    const char *env = getenv("BOX64_DYNAREC_CACHE_MAX");
+    size_t budget = env && *env ? parse_size(env) : 0;
+    int have_budget = budget > 0;
+    if (!have_budget)
+        budget = DEFAULT_BUDGET;
+
+    printf("########################################\n");
+    printf(" BENCHMARK 509: working sets over a capped code cache\n");
+    printf("########################################\n\n");
+
+    size_t func_bytes = measure_func_bytes();
+    int measured = func_bytes > 0;
+    if (!measured)
+        func_bytes = DEFAULT_FUNC_BYTES;
+
+    printf("Budget:         %zu KiB%s\n", budget >> 10,
+           have_budget ? " (BOX64_DYNAREC_CACHE_MAX)" :
+           env && *env ? " (default, BOX64_DYNAREC_CACHE_MAX is not a size: no eviction)" :
+                         " (default, BOX64_DYNAREC_CACHE_MAX unset: no eviction)");
+    printf("Bytes/function: %zu (%s)\n", func_bytes,
+           measured ? "box64_stats()" : "assumed, libbox64ctl not answered");
+    printf("Evictions:      %s\n",
+           box64_stats_enabled() ? "cache_evicted_blocks (stats dump)" : "- (BOX64_DYNAREC_STATS unset)");
+    printf("Run time:       %d ms per row, calls > %d us count as slow\n\n",
+           run_ms, SLOW_NS / 1000);
+
+    printf("  +----------+-----------+--------+----------+-----------+---------+--------+-----------+\n");
+    printf("  | WS funcs | WS/budget | Order  | Mcalls/s | evicted/s |  slow/s |  slow  | cache KiB |\n");
+    printf("  +----------+-----------+--------+----------+-----------+---------+--------+-----------+\n");
+
+    int capped = 0;
+    for (size_t i = 0; i < sizeof(ratios) / sizeof(ratios[0]); i++) {
+        size_t want = (size_t)(ratios[i] * budget / func_bytes);
+        int ws = want > NUM_FUNCS ? NUM_FUNCS : want < 1 ? 1 : (int)want;
+        if (want > NUM_FUNCS)
+            capped = 1;
+        for (int order = 0; order < 2; order++) {
+            row_result_t r;
+            box64ctl_stats_t s;
+            char cache[24] = "-", evicted[24] = "-";
+
+            run_row(ws, order, run_ms, &r);
+            if (box64ctl_stats(&s) == 0)
+                snprintf(cache, sizeof(cache), "%llu", (unsigned long long)(s.alloc_bytes >> 10));
+            double secs = r.ns / 1e9;
+            if (r.evicted >= 0)
+                snprintf(evicted, sizeof(evicted), "%.0f", r.evicted / secs);
+            printf("  | %8d | %8.1fx%s| %-6s | %8.2f | %9s | %7.0f | %5.2f%% | %9s |\n",
+                   ws, (double)ws * func_bytes / budget, want > NUM_FUNCS ? "*" : " ",
+                   order ? "random" : "loop", r.calls / secs / 1e6, evicted, r.slow / secs,
+                   r.calls ? 100.0 * r.slow / r.calls : 0.0, cache);
+            if (r.sink == 42)
+                printf("\n");
+        }
+    }
+    printf("  +----------+-----------+--------+----------+-----------+---------+--------+-----------+\n");
+    if (capped)
+        printf("  * working set capped at NUM_FUNCS = %d: lower the budget to reach this ratio\n",
+               NUM_FUNCS);
+    printf("\nevicted/s should stay at 0 up to 1x and grow past it, with slow/s\n");
+    printf("above the noise floor; loop order is the worst case for LRU, random\n");
+    printf("order shows the steady eviction rate.\n");
+    return 0;
+}
@@ -0,0 +1,51 @@
+/*
+ * libcycle.so - dlopen target for 510_dlopen_cycle_alloc.
+ *
+ * Under box64 with dynarec, the blocks compiled from this library go to
+ * the mapping's own mmaplist_t, created on dlopen and freed on dlclose.
+ * cycle_hot() compiles to a handful of blocks; calling all of
+ * cycle_funcs[] makes the mapping's chunks array grow.
+ */
+
+/* 256 distinct functions fn_10000 .. fn_13333 (base-4 ids, as in 509) */
+#define GEN_FUNC(n)                                 \
+    __attribute__((noinline))                       \
+    static long fn_##n(long x)                      \
+    {                                               \
+        if (x & 1)                                  \
+            x = x * (n) + 0x##n;                    \
+        else                                        \
+            x ^= (x >> 3) + (n);                    \
+        if (x & 2)                                  \
+            x += (x << 2) ^ (n);                    \
+        else                                        \
+            x -= (n) >> 1;                          \
+        return x + ((n) & 0xff);                    \
+    }
+#define GEN_PTR(n) fn_##n,
+
+#define L0(X, p) X(p##0) X(p##1) X(p##2) X(p##3)
+#define L1(X, p) L0(X, p##0) L0(X, p##1) L0(X, p##2) L0(X, p##3)
+#define L2(X, p) L1(X, p##0) L1(X, p##1) L1(X, p##2) L1(X, p##3)
+#define L3(X, p) L2(X, p##0) L2(X, p##1) L2(X, p##2) L2(X, p##3)
+
+L3(GEN_FUNC, 1)
+
+__attribute__((visibility("default")))
+long (*const cycle_funcs[])(long) = { L3(GEN_PTR, 1) };
+
+__attribute__((visibility("default")))
+const int cycle_nfuncs = sizeof(cycle_funcs) / sizeof(cycle_funcs[0]);
+
+/* Same loop as 003's hot_compute() */
+__attribute__((visibility("default")))
+int cycle_hot(int n)
+{
+    volatile int sum = 0;
+    for (int i = 0; i < n; i++) {
+        sum += i * i;
+        sum ^= (i << 2);
+        sum += (i & 0xFF) * 3;
+    }
+    return sum;
+}
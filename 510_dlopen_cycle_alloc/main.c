@@ -0,0 +1,221 @@
+/*
+ * 510_dlopen_cycle_alloc
+ *
+ * Benchmark: dlopen/dlclose cycle cost and box64 allocator traffic for
+ * the per-mapping mmaplist
+ *
+ * Background:
+ *   Every dlopen() under box64 gives the new mapping its own mmaplist_t
+ *   (test 003). While the library runs, MmaplistAddBlock() grows its
+ *   chunks array with box_realloc(), and dlclose() frees both again in
+ *   DelMmaplist(). A program that loads and unloads plugins pays these
+ *   allocator calls on every cycle. patches/mmaplist_slab.patch moves
+ *   them to a size-classed slab with O(1) recycling, and adds allocator
+ *   counters (slab_requests, slab_mallocs) to the 001 stats dump.
+ *
+ * What this benchmark does:
+ *   Same cycle as 003's Phase 2, on libcycle.so: dlopen(RTLD_NOW), call
+ *   into the library, dlclose(). Two scenarios:
+ *     light - cycle_hot() only: a few blocks, one chunk
+ *     heavy - all 256 cycle_funcs[] as well: the chunks array grows
+ *   After WARM_CYCLES unmeasured cycles, every cycle is timed in three
+ *   parts (dlopen, calls, dlclose). Reported per scenario: cycles/s,
+ *   median and p99 of the whole cycle, and median dlopen + dlclose.
+ *
+ *   With BOX64_DYNAREC_STATS set (001 patch), a stats snapshot before and
+ *   after each scenario gives the slab requests per cycle (one allocator
+ *   call each without the slab) and the allocator calls the slab made.
+ *   Without the slab patch these columns read n/a.
+ *
+ * Run:
+ *   ./510_dlopen_cycle_alloc [cycles]
+ *   BOX64_DYNAREC=1 box64 ./510_dlopen_cycle_alloc
+ *   BOX64_DYNAREC=1 BOX64_DYNAREC_STATS=/tmp/box64_stats.%p.json \
+ *       box64 ./510_dlopen_cycle_alloc
+ *
+ *   Default: 300 cycles per scenario. libcycle.so is loaded from the
+ *   directory of the binary.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <time.h>
+
+#include "../common/box64_stats.h"
+
+/* Configuration */
+#define DEFAULT_CYCLES  300     /* Measured cycles per scenario */
+#define WARM_CYCLES     20      /* Unmeasured cycles before each scenario */
+#define HOT_ITERS       2000    /* cycle_hot() argument, as in 003 */
+#define HOT_CALLS       20      /* cycle_hot() calls per cycle */
+
+static volatile long sink;
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* ── One cycle ───────────────────────────────────────────────────── */
+
+typedef struct {
+    uint64_t open_ns;
+    uint64_t call_ns;
+    uint64_t close_ns;
+} cycle_time_t;
+
+static int run_cycle(const char *lib_path, int heavy, cycle_time_t *t)
+{
+    typedef int (*hot_fn)(int);
+    typedef long (*gen_fn)(long);
+
+    uint64_t t0 = now_ns();
+    void *handle = dlopen(lib_path, RTLD_NOW);
+    if (!handle)
+        return -1;
+    uint64_t t1 = now_ns();
+
+    hot_fn hot = (hot_fn)dlsym(handle, "cycle_hot");
+    gen_fn const *funcs = dlsym(handle, "cycle_funcs");
+    const int *nfuncs = dlsym(handle, "cycle_nfuncs");
+    if (hot)
+        for (int j = 0; j < HOT_CALLS; j++)
+            sink += hot(HOT_ITERS);
+    if (heavy && funcs && nfuncs) {
+        long x = 1;
+        for (int i = 0; i < *nfuncs; i++)
+            x = funcs[i](x);
+        sink += x;
+    }
+    uint64_t t2 = now_ns();
+
+    /* RemoveMapping -> DelMmaplist */
+    dlclose(handle);
+    uint64_t t3 = now_ns();
+
+    t->open_ns = t1 - t0;
+    t->call_ns = t2 - t1;
+    t->close_ns = t3 - t2;
+    return 0;
+}
+
+/* ── Statistics ──────────────────────────────────────────────────── */
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* p in [0, 100]; sorts v */
+static uint64_t percentile(uint64_t *v, int n, int p)
+{
+    qsort(v, n, sizeof(v[0]), cmp_u64);
+    int i = (int)((long)(n - 1) * p / 100);
+    return v[i];
+}
+
+/* Per-cycle delta of a stats field, formatted, or "n/a" if missing */
+static void fmt_delta(char *buf, size_t size, const char *before, const char *after,
+                      const char *key, int cycles)
+{
+    long a = box64_stats_get(before, key), b = box64_stats_get(after, key);
+    if (a < 0 || b < 0)
+        snprintf(buf, size, "n/a");
+    else
+        snprintf(buf, size, "%.2f", (double)(b - a) / cycles);
+}
+
+int main(int argc, char *argv[])
+{
+    static const char *names[2] = { "light", "heavy" };
+    int num_cycles = argc > 1 ? atoi(argv[1]) : DEFAULT_CYCLES;
+    if (num_cycles < 1)
+        num_cycles = DEFAULT_CYCLES;
+
+    /* libcycle.so next to the binary */
+    char lib_path[4096];
+    const char *slash = strrchr(argv[0], '/');
+    if (slash)
+        snprintf(lib_path, sizeof(lib_path), "%.*s/libcycle.so", (int)(slash - argv[0]), argv[0]);
+    else
+        snprintf(lib_path, sizeof(lib_path), "./libcycle.so");
+
+    printf("########################################\n");
+    printf(" BENCHMARK 510: dlopen/dlclose cycles and mmaplist allocations\n");
+    printf("########################################\n\n");
+
+    cycle_time_t probe;
+    if (run_cycle(lib_path, 0, &probe) != 0) {
+        printf("ERROR: dlopen(%s): %s\n", lib_path, dlerror());
+        return 1;
+    }
+
+    int use_stats = box64_stats_enabled();
+    printf("Library:  %s\n", lib_path);
+    printf("Cycles:   %d per scenario, after %d warm-up cycles\n", num_cycles, WARM_CYCLES);
+    printf("Stats:    %s\n\n", use_stats ? "BOX64_DYNAREC_STATS (slab counters per cycle)"
+                                         : "off (set BOX64_DYNAREC_STATS for allocator counters)");
+
+    uint64_t *total = malloc(num_cycles * sizeof(uint64_t));
+    uint64_t *openclose = malloc(num_cycles * sizeof(uint64_t));
+    if (!total || !openclose)
+        return 1;
+
+    printf("  +----------+----------+-----------+-----------+---------------+--------------+--------------+\n");
+    printf("  | Scenario | cycles/s | median us |    p99 us | open+close us | requests/cyc |  mallocs/cyc |\n");
+    printf("  +----------+----------+-----------+-----------+---------------+--------------+--------------+\n");
+
+    int failed = 0;
+    for (int heavy = 0; heavy < 2; heavy++) {
+        cycle_time_t t;
+        for (int i = 0; i < WARM_CYCLES; i++)
+            run_cycle(lib_path, heavy, &t);
+
+        char *before = use_stats ? box64_stats_snapshot() : NULL;
+        uint64_t start = now_ns();
+        int done = 0;
+        for (int i = 0; i < num_cycles; i++) {
+            if (run_cycle(lib_path, heavy, &t) != 0) {
+                failed++;
+                continue;
+            }
+            total[done] = t.open_ns + t.call_ns + t.close_ns;
+            openclose[done] = t.open_ns + t.close_ns;
+            done++;
+        }
+        uint64_t elapsed = now_ns() - start;
+        char *after = use_stats ? box64_stats_snapshot() : NULL;
+
+        char req[16] = "-", mal[16] = "-";
+        if (before && after) {
+            fmt_delta(req, sizeof(req), before, after, "slab_requests", num_cycles);
+            fmt_delta(mal, sizeof(mal), before, after, "slab_mallocs", num_cycles);
+        }
+        free(before);
+        free(after);
+        if (done == 0)
+            continue;
+
+        printf("  | %-8s | %8.0f | %9.1f | %9.1f | %13.1f | %12s | %12s |\n",
+               names[heavy], done / (elapsed / 1e9),
+               percentile(total, done, 50) / 1e3, percentile(total, done, 99) / 1e3,
+               percentile(openclose, done, 50) / 1e3, req, mal);
+    }
+    printf("  +----------+----------+-----------+-----------+---------------+--------------+--------------+\n");
+    free(total);
+    free(openclose);
+
+    if (failed)
+        printf("\nWARNING: %d cycles failed to dlopen %s\n", failed, lib_path);
+    printf("\nrequests/cyc is what the mmaplist costs in allocator calls without the\n");
+    printf("slab; mallocs/cyc is what the slab actually asked for (near 0 once warm).\n");
+    return failed ? 1 : 0;
+}
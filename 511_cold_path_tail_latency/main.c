@@ -0,0 +1,209 @@
+/*
+ * 511_cold_path_tail_latency
+ *
+ * Benchmark: request latency tail when some requests reach code that has
+ * never run
+ *
+ * Background:
+ *   The first time box64 reaches an x86 address without a dynablock, the
+ *   thread stops and compiles it (DBGetBlock -> FillBlock64) before it
+ *   runs a single instruction. For a server loop, a request that takes a
+ *   cold path (an error branch, a rare format, the first use of a
+ *   feature) pays that compile in its latency. With
+ *   patches/dynarec_background_jit.patch and BOX64_DYNAREC_BACKGROUND=<n>,
+ *   worker threads compile the block while the requesting thread runs it
+ *   in the interpreter, trading a slower first run for no stall.
+ *
+ * What this benchmark does:
+ *   A single-threaded request loop. Every request runs the same hot
+ *   handler (HOT_ITERS iterations, compiled after warm-up). A share of
+ *   the requests also calls one cold function that has never run
+ *   before; NUM_COLD generated functions provide them, and each is used
+ *   once. Cold requests are spread evenly through the run.
+ *
+ *   For 0%, 0.5%, 2% and 5% cold requests it times every request and
+ *   reports requests/s, p50, p99, p99.9 and max latency, and the number
+ *   of stalls (requests slower than STALL_US).
+ *
+ * Run:
+ *   ./511_cold_path_tail_latency [requests]
+ *   BOX64_DYNAREC=1 box64 ./511_cold_path_tail_latency
+ *   BOX64_DYNAREC=1 BOX64_DYNAREC_BACKGROUND=2 box64 ./511_cold_path_tail_latency
+ *
+ *   Default: 10000 requests per row. The rows together need
+ *   requests * 7.5% cold functions; more are capped at NUM_COLD.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Configuration */
+#define NUM_COLD          1024      /* Generated cold functions (4^5), each used once */
+#define DEFAULT_REQUESTS  10000     /* Requests per row */
+#define WARMUP_REQUESTS   2000      /* Hot-only requests before the first row */
+#define HOT_ITERS         200       /* Hot handler loop per request */
+#define STALL_US          100       /* Slower requests count as stalls */
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* ── Generated cold code ─────────────────────────────────────────── */
+
+/*
+ * NUM_COLD distinct functions cold_100000 .. cold_133333 (base-4 ids, as
+ * in 509). A switch and a short loop give each a few blocks, about what
+ * a small error or format handler compiles to.
+ */
+#define GEN_COLD(n)                                 \
+    __attribute__((noinline))                       \
+    static long cold_##n(long x)                    \
+    {                                               \
+        switch (x & 3) {                            \
+        case 0: x = x * (n) + 0x##n; break;         \
+        case 1: x ^= (x >> 3) + (n); break;         \
+        case 2: x += (x << 2) ^ (n); break;         \
+        default: x -= (n) >> 1; break;              \
+        }                                           \
+        for (int i = 0; i < ((n) & 7) + 2; i++)     \
+            x = (x << 1) ^ (x >> 5) ^ i;            \
+        return x + ((n) & 0xff);                    \
+    }
+#define GEN_PTR(n) cold_##n,
+
+#define L0(X, p) X(p##0) X(p##1) X(p##2) X(p##3)
+#define L1(X, p) L0(X, p##0) L0(X, p##1) L0(X, p##2) L0(X, p##3)
+#define L2(X, p) L1(X, p##0) L1(X, p##1) L1(X, p##2) L1(X, p##3)
+#define L3(X, p) L2(X, p##0) L2(X, p##1) L2(X, p##2) L2(X, p##3)
+#define L4(X, p) L3(X, p##0) L3(X, p##1) L3(X, p##2) L3(X, p##3)
+
+L4(GEN_COLD, 1)
+
+typedef long (*cold_func_t)(long);
+static cold_func_t cold_funcs[NUM_COLD] = { L4(GEN_PTR, 1) };
+static int next_cold = 0;
+
+/* ── Request loop ────────────────────────────────────────────────── */
+
+__attribute__((noinline))
+static long hot_request(long x)
+{
+    for (int i = 0; i < HOT_ITERS; i++) {
+        if (x & 1)
+            x = x * 3 + i;
+        else
+            x = (x >> 1) ^ i;
+    }
+    return x;
+}
+
+typedef struct {
+    double req_per_s;
+    uint64_t p50, p99, p999, max;
+    int stalls;
+    int cold_used;
+} row_result_t;
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* cold_permille of the requests, spread evenly, call one new cold function */
+static long run_row(int requests, int cold_permille, uint64_t *lat, row_result_t *r)
+{
+    long x = 1;
+    int acc = 0, used = 0;
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < requests; i++) {
+        uint64_t t0 = now_ns();
+        x = hot_request(x);
+        acc += cold_permille;
+        if (acc >= 1000) {
+            acc -= 1000;
+            if (next_cold < NUM_COLD) {
+                x = cold_funcs[next_cold++](x);
+                used++;
+            }
+        }
+        lat[i] = now_ns() - t0;
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    r->req_per_s = requests / (elapsed / 1e9);
+    r->stalls = 0;
+    for (int i = 0; i < requests; i++)
+        if (lat[i] > STALL_US * 1000ULL)
+            r->stalls++;
+    qsort(lat, requests, sizeof(lat[0]), cmp_u64);
+    r->p50 = lat[(requests - 1) / 2];
+    r->p99 = lat[(int)((long)(requests - 1) * 990 / 1000)];
+    r->p999 = lat[(int)((long)(requests - 1) * 999 / 1000)];
+    r->max = lat[requests - 1];
+    r->cold_used = used;
+    return x;
+}
+
+int main(int argc, char *argv[])
+{
+    static const int cold_permille[] = { 0, 5, 20, 50 };
+    int requests = argc > 1 ? atoi(argv[1]) : DEFAULT_REQUESTS;
+    if (requests < 100)
+        requests = DEFAULT_REQUESTS;
+
+    const char *bg = getenv("BOX64_DYNAREC_BACKGROUND");
+
+    printf("########################################\n");
+    printf(" BENCHMARK 511: cold-path tail latency\n");
+    printf("########################################\n\n");
+    printf("Requests:  %d per row, after %d hot-only warm-up requests\n",
+           requests, WARMUP_REQUESTS);
+    printf("Stall:     request slower than %d us\n", STALL_US);
+    printf("Compile:   %s\n\n", bg && atoi(bg) > 0 ?
+           "BOX64_DYNAREC_BACKGROUND set (background workers, if patched)" :
+           "BOX64_DYNAREC_BACKGROUND unset (blocking compile)");
+
+    uint64_t *lat = malloc(requests * sizeof(uint64_t));
+    if (!lat)
+        return 1;
+
+    long sink = 1;
+    for (int i = 0; i < WARMUP_REQUESTS; i++)
+        sink = hot_request(sink);
+
+    printf("  +--------+-------------+--------+--------+----------+----------+--------+\n");
+    printf("  | Cold   |  requests/s | p50 us | p99 us | p99.9 us |   max us | stalls |\n");
+    printf("  +--------+-------------+--------+--------+----------+----------+--------+\n");
+
+    int capped = 0;
+    for (size_t i = 0; i < sizeof(cold_permille) / sizeof(cold_permille[0]); i++) {
+        row_result_t r;
+        int want = (int)((long)requests * cold_permille[i] / 1000);
+        sink += run_row(requests, cold_permille[i], lat, &r);
+        if (r.cold_used < want)
+            capped = 1;
+        printf("  | %5.1f%%%s| %11.0f | %6.1f | %6.1f | %8.1f | %8.1f | %6d |\n",
+               cold_permille[i] / 10.0, r.cold_used < want ? "*" : " ", r.req_per_s,
+               r.p50 / 1e3, r.p99 / 1e3, r.p999 / 1e3, r.max / 1e3, r.stalls);
+    }
+    printf("  +--------+-------------+--------+--------+----------+----------+--------+\n");
+    if (capped)
+        printf("  * ran out of cold functions (NUM_COLD = %d): fewer requests were cold\n",
+               NUM_COLD);
+    free(lat);
+
+    printf("\nWith blocking compiles, stalls follow the cold requests one for one and\n");
+    printf("p99 jumps to the compile time once cold requests pass 1%%.\n");
+    if (sink == 42)
+        printf("\n");
+    return 0;
+}
@@ -0,0 +1,353 @@
+/*
+ * 512_tiered_threshold
+ *
+ * Benchmark: total run time of cold-heavy and hot-heavy code against the
+ * dynarec compile threshold
+ *
+ * Background:
+ *   box64 compiles every x86 block the first time it is reached. A
+ *   startup-heavy program runs a lot of code exactly once (loader work,
+ *   static initializers, setup paths), and each of those blocks costs a
+ *   compile that never pays off. patches/dynarec_tiered_threshold.patch
+ *   adds BOX64_DYNAREC_THRESHOLD=<n>: a block runs in the interpreter
+ *   until it has been reached n times, and only then is compiled. Code
+ *   that runs once is never compiled; a hot loop pays n interpreted
+ *   iterations before it runs native code.
+ *
+ * What this benchmark does:
+ *   The benchmark re-executes itself as a child (argv[0] --child) once
+ *   per threshold and run, with BOX64_DYNAREC_THRESHOLD set for that row,
+ *   so under box64 every row is a fresh process. The child runs two
+ *   workloads:
+ *     cold - NUM_COLD distinct functions, each called once. They are
+ *            generated at run time into an executable mapping (COLD_SIZE
+ *            bytes each, two blocks: a branch over an xor), since a C
+ *            file with 100k functions would take too long to build.
+ *     hot  - 001's four hot_compute loops, HOT_ITERS iterations each
+ *   Reported per threshold: the median time of each workload, their sum,
+ *   the whole child process (fork to exit, which includes box64 and libc
+ *   startup, itself cold code) and the sum relative to the first row.
+ *
+ *   The child checks the result of the generated code against the same
+ *   computation in C and fails the run on a mismatch.
+ *
+ * Run:
+ *   ./512_tiered_threshold [runs]
+ *   BOX64_DYNAREC=1 box64 ./512_tiered_threshold
+ *
+ *   Default: 3 runs per threshold. The first row unsets
+ *   BOX64_DYNAREC_THRESHOLD (compile on first run).
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+
+/* Configuration */
+#define NUM_COLD      100000    /* Generated functions, each called once */
+#define COLD_SIZE     32        /* Bytes of code per generated function */
+#define HOT_ITERS     5000000   /* Iterations per hot_compute loop */
+#define DEFAULT_RUNS  3         /* Child runs per threshold */
+#define MAX_RUNS      15
+
+static const char *thresholds[] = { NULL, "2", "10", "100", "1000" };
+#define NUM_THRESHOLDS (int)(sizeof(thresholds) / sizeof(thresholds[0]))
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* ── Cold code, generated ────────────────────────────────────────── */
+
+/* Per-function constants; all below 2^31, so sign extension is a no-op */
+static uint32_t cold_k(uint32_t i, uint32_t salt)
+{
+    return ((i + 1) * 2654435761u ^ salt) & 0x7fffffff;
+}
+
+/*
+ * Function i, in x86-64:
+ *   48 89 f8              mov  rax, rdi
+ *   48 69 c0 k1           imul rax, rax, k1
+ *   48 05 k2              add  rax, k2
+ *   a8 01                 test al, 1
+ *   74 06                 jz   1f
+ *   48 35 k3              xor  rax, k3
+ *   48 c1 e8 03       1:  shr  rax, 3
+ *   c3                    ret
+ * padded with int3 to COLD_SIZE.
+ */
+static void emit_cold(uint8_t *p, uint32_t i)
+{
+    uint32_t k1 = cold_k(i, 0x1234567) | 1, k2 = cold_k(i, 0x2468ace), k3 = cold_k(i, 0x13579bd);
+    uint8_t *q = p;
+
+    memset(p, 0xcc, COLD_SIZE);
+    *q++ = 0x48; *q++ = 0x89; *q++ = 0xf8;
+    *q++ = 0x48; *q++ = 0x69; *q++ = 0xc0; memcpy(q, &k1, 4); q += 4;
+    *q++ = 0x48; *q++ = 0x05; memcpy(q, &k2, 4); q += 4;
+    *q++ = 0xa8; *q++ = 0x01;
+    *q++ = 0x74; *q++ = 0x06;
+    *q++ = 0x48; *q++ = 0x35; memcpy(q, &k3, 4); q += 4;
+    *q++ = 0x48; *q++ = 0xc1; *q++ = 0xe8; *q++ = 0x03;
+    *q++ = 0xc3;
+}
+
+/* The same computation in C, to check the generated code */
+static uint64_t cold_ref(uint32_t i, uint64_t x)
+{
+    x = x * (cold_k(i, 0x1234567) | 1) + cold_k(i, 0x2468ace);
+    if (x & 1)
+        x ^= cold_k(i, 0x13579bd);
+    return x >> 3;
+}
+
+/* ── Hot code, as in 001 ─────────────────────────────────────────── */
+
+__attribute__((noinline, optimize("O2")))
+static long hot_compute_0(long iterations)
+{
+    long sum = 0;
+    for (long i = 0; i < iterations; i++)
+        sum += i * i;
+    return sum;
+}
+
+__attribute__((noinline, optimize("O2")))
+static long hot_compute_1(long iterations)
+{
+    long sum = 0;
+    for (long i = 0; i < iterations; i++)
+        sum += i * (i + 1);
+    return sum;
+}
+
+__attribute__((noinline, optimize("O2")))
+static long hot_compute_2(long iterations)
+{
+    long sum = 0;
+    for (long i = 0; i < iterations; i++)
+        sum += (i << 1) ^ i;
+    return sum;
+}
+
+__attribute__((noinline, optimize("O2")))
+static long hot_compute_3(long iterations)
+{
+    long sum = 0;
+    for (long i = 0; i < iterations; i++)
+        sum += i + (i & 0xFF);
+    return sum;
+}
+
+/* ── Child ───────────────────────────────────────────────────────── */
+
+typedef struct {
+    uint64_t cold_ns;
+    uint64_t hot_ns;
+    int mismatch;
+    long sink;
+} child_result_t;
+
+static int child_main(int fd)
+{
+    typedef uint64_t (*cold_func_t)(uint64_t);
+    child_result_t r;
+    size_t size = (size_t)NUM_COLD * COLD_SIZE;
+
+    memset(&r, 0, sizeof(r));
+    uint8_t *code = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    for (uint32_t i = 0; i < NUM_COLD; i++)
+        emit_cold(code + (size_t)i * COLD_SIZE, i);
+    if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
+        perror("mprotect");
+        return 1;
+    }
+
+    uint64_t x = 1;
+    uint64_t t0 = now_ns();
+    for (uint32_t i = 0; i < NUM_COLD; i++)
+        x = ((cold_func_t)(code + (size_t)i * COLD_SIZE))(x);
+    uint64_t t1 = now_ns();
+
+    uint64_t ref = 1;
+    for (uint32_t i = 0; i < NUM_COLD; i++)
+        ref = cold_ref(i, ref);
+    r.mismatch = x != ref;
+
+    uint64_t t2 = now_ns();
+    long sum = hot_compute_0(HOT_ITERS);
+    sum += hot_compute_1(HOT_ITERS);
+    sum += hot_compute_2(HOT_ITERS);
+    sum += hot_compute_3(HOT_ITERS);
+    uint64_t t3 = now_ns();
+
+    r.cold_ns = t1 - t0;
+    r.hot_ns = t3 - t2;
+    r.sink = sum + (long)x;
+    munmap(code, size);
+
+    if (write(fd, &r, sizeof(r)) != (ssize_t)sizeof(r))
+        return 1;
+    close(fd);
+    return 0;
+}
+
+/* ── Parent ──────────────────────────────────────────────────────── */
+
+typedef struct {
+    double cold_ms;
+    double hot_ms;
+    double process_ms;
+} run_result_t;
+
+/* Run one child with the threshold already in the environment */
+static int run_child(const char *self, run_result_t *out)
+{
+    int pfd[2];
+    char fdarg[16];
+    child_result_t r;
+
+    if (pipe(pfd) != 0) {
+        perror("pipe");
+        return -1;
+    }
+    snprintf(fdarg, sizeof(fdarg), "%d", pfd[1]);
+
+    uint64_t t_fork = now_ns();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        close(pfd[0]);
+        execlp(self, self, "--child", fdarg, (char *)NULL);
+        perror(self);
+        _exit(127);
+    }
+    close(pfd[1]);
+
+    size_t got = 0;
+    while (got < sizeof(r)) {
+        ssize_t n = read(pfd[0], (char *)&r + got, sizeof(r) - got);
+        if (n <= 0)
+            break;
+        got += n;
+    }
+    close(pfd[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    uint64_t t_exit = now_ns();
+    if (got != sizeof(r) || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "child failed (status 0x%x, %zu bytes)\n", status, got);
+        return -1;
+    }
+    if (r.mismatch) {
+        fprintf(stderr, "child: generated code returned a wrong result\n");
+        return -1;
+    }
+
+    out->cold_ms = r.cold_ns / 1e6;
+    out->hot_ms = r.hot_ns / 1e6;
+    out->process_ms = (t_exit - t_fork) / 1e6;
+    return 0;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double median(double *v, int n)
+{
+    qsort(v, n, sizeof(v[0]), cmp_double);
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+static void print_separator(void)
+{
+    printf("  +-----------+-----------+-----------+-------------+------------+----------+\n");
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc == 3 && strcmp(argv[1], "--child") == 0)
+        return child_main(atoi(argv[2]));
+
+    int runs = argc > 1 ? atoi(argv[1]) : DEFAULT_RUNS;
+    if (runs < 1)
+        runs = DEFAULT_RUNS;
+    if (runs > MAX_RUNS)
+        runs = MAX_RUNS;
+
+    printf("########################################\n");
+    printf(" BENCHMARK 512: tiered execution threshold\n");
+    printf("########################################\n\n");
+    printf("Cold:     %d generated functions, each called once\n", NUM_COLD);
+    printf("Hot:      4 loops x %d iterations (001's hot_compute)\n", HOT_ITERS);
+    printf("Runs:     %d per threshold (medians), BOX64_DYNAREC_THRESHOLD set per row\n\n",
+           runs);
+
+    print_separator();
+    printf("  | Threshold |   cold ms |    hot ms | cold+hot ms | process ms | vs first |\n");
+    print_separator();
+
+    double base = 0;
+    int failed = 0;
+    for (int t = 0; t < NUM_THRESHOLDS; t++) {
+        double cold[MAX_RUNS], hot[MAX_RUNS], sum[MAX_RUNS], proc[MAX_RUNS];
+        int ok = 0;
+
+        if (thresholds[t])
+            setenv("BOX64_DYNAREC_THRESHOLD", thresholds[t], 1);
+        else
+            unsetenv("BOX64_DYNAREC_THRESHOLD");
+
+        for (int i = 0; i < runs; i++) {
+            run_result_t r;
+            if (run_child(argv[0], &r) != 0) {
+                failed++;
+                continue;
+            }
+            cold[ok] = r.cold_ms;
+            hot[ok] = r.hot_ms;
+            sum[ok] = r.cold_ms + r.hot_ms;
+            proc[ok] = r.process_ms;
+            ok++;
+        }
+        if (!ok)
+            continue;
+
+        double s = median(sum, ok);
+        if (t == 0)
+            base = s;
+        printf("  | %-9s | %9.2f | %9.2f | %11.2f | %10.2f | %7.2fx |\n",
+               thresholds[t] ? thresholds[t] : "unset", median(cold, ok), median(hot, ok),
+               s, median(proc, ok), base > 0 ? s / base : 0.0);
+    }
+    print_separator();
+
+    printf("\ncold ms should drop once the threshold is above 1 (the functions run\n");
+    printf("once and are never compiled); hot ms grows with the interpreted runs.\n");
+    if (failed) {
+        printf("\nFAIL: %d child runs failed\n", failed);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,335 @@
+/*
+ * 513_hot_loop_kernels
+ *
+ * Benchmark: steady-state speed of hot loops with and without the hot
+ * block rebuild
+ *
+ * Background:
+ *   box64 compiles a block once, with the same options whether it runs
+ *   once or billions of times. Loops like 001's hot_compute_0 are split
+ *   at their branches into several blocks that jump to each other through
+ *   the jump table, and flags and cached registers do not survive a block
+ *   boundary. patches/dynarec_hot_recompile.patch adds
+ *   BOX64_DYNAREC_HOTRECOMPILE=<n>: a CPU-time sampler finds the blocks
+ *   that run most, and rebuilds them with bigger-block options, so a loop
+ *   stays in one block.
+ *
+ * What this benchmark does:
+ *   The benchmark re-executes itself as a child (argv[0] --child), in
+ *   REPEATS pairs: one child with BOX64_DYNAREC_HOTRECOMPILE unset ("off")
+ *   and one with it set to hot_n ("on"), so under box64 each is a fresh
+ *   process. Interleaving the pairs spreads CPU frequency and load
+ *   changes over both sides. The child runs every kernel for ROUNDS
+ *   rounds of ITERS iterations, one kernel after the other, so each is
+ *   the hot code while it runs. Kernels:
+ *     001 - hot_compute_0..3, with 001's stop-flag check in the loop
+ *     003 - libhot's hot_compute and hot_compute_alt (volatile sum)
+ *     gen - eight GEN_KERNEL loops over two arrays: sums, stores, a
+ *           data-dependent branch, a bitwise CRC step and shifts
+ *   The steady state of a kernel is the median round of the second half.
+ *   For each side the fastest steady state over the repeats is reported
+ *   in ns per iteration, with the speedup and its geometric mean over all
+ *   kernels.
+ *
+ * Run:
+ *   ./513_hot_loop_kernels [hot_n]
+ *   BOX64_DYNAREC=1 box64 ./513_hot_loop_kernels
+ *
+ *   Default hot_n: 4 samples. Rebuilding needs the patch; otherwise both
+ *   children run the same code and the speedup is noise.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/wait.h>
+#include <time.h>
+
+/* Configuration */
+#define ITERS         1000000   /* Iterations per kernel per round */
+#define ROUNDS        30        /* Rounds per kernel; the second half is steady */
+#define ARRAY_LEN     4096      /* int32 elements per array (power of 2) */
+#define DEFAULT_HOT_N "4"       /* BOX64_DYNAREC_HOTRECOMPILE for the "on" children */
+#define REPEATS       3         /* off/on child pairs; fastest steady state kept */
+
+static volatile int stop_workers = 0;
+static int32_t arr_a[ARRAY_LEN], arr_b[ARRAY_LEN];
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* ── 001's hot loops ─────────────────────────────────────────────── */
+
+__attribute__((noinline, optimize("O2")))
+static long hot_compute_0(long iterations)
+{
+    long sum = 0;
+    for (long i = 0; i < iterations; i++) {
+        sum += i * i;
+        if ((i & 0x3FFFF) == 0 && stop_workers)
+            return sum;
+    }
+    return sum;
+}
+
+__attribute__((noinline, optimize("O2")))
+static long hot_compute_1(long iterations)
+{
+    long sum = 0;
+    for (long i = 0; i < iterations; i++) {
+        sum += i * (i + 1);
+        if ((i & 0x3FFFF) == 0 && stop_workers)
+            return sum;
+    }
+    return sum;
+}
+
+__attribute__((noinline, optimize("O2")))
+static long hot_compute_2(long iterations)
+{
+    long sum = 0;
+    for (long i = 0; i < iterations; i++) {
+        sum += (i << 1) ^ i;
+        if ((i & 0x3FFFF) == 0 && stop_workers)
+            return sum;
+    }
+    return sum;
+}
+
+__attribute__((noinline, optimize("O2")))
+static long hot_compute_3(long iterations)
+{
+    long sum = 0;
+    for (long i = 0; i < iterations; i++) {
+        sum += i + (i & 0xFF);
+        if ((i & 0x3FFFF) == 0 && stop_workers)
+            return sum;
+    }
+    return sum;
+}
+
+/* ── 003's libhot loops ──────────────────────────────────────────── */
+
+__attribute__((noinline))
+static long lib_hot_compute(long n)
+{
+    volatile int sum = 0;
+    for (int i = 0; i < n; i++) {
+        sum += i * i;
+        sum ^= (i << 2);
+        sum += (i & 0xFF) * 3;
+    }
+    return sum;
+}
+
+__attribute__((noinline))
+static long lib_hot_compute_alt(long n)
+{
+    volatile int sum = 0;
+    for (int i = 0; i < n; i++) {
+        sum += i * (i + 1) / 2;
+        sum ^= (i >> 1);
+    }
+    return sum;
+}
+
+/* ── Generated loop kernels ──────────────────────────────────────── */
+
+/* One loop over arr_a/arr_b; j cycles through the arrays, acc is the result */
+#define GEN_KERNEL(name, body)                              \
+    __attribute__((noinline))                               \
+    static long name(long iters)                            \
+    {                                                       \
+        long acc = 1;                                       \
+        for (long i = 0; i < iters; i++) {                  \
+            long j = i & (ARRAY_LEN - 1);                   \
+            body;                                           \
+        }                                                   \
+        return acc;                                         \
+    }
+
+GEN_KERNEL(gen_sum,    acc += arr_a[j])
+GEN_KERNEL(gen_dot,    acc += (long)arr_a[j] * arr_b[j])
+GEN_KERNEL(gen_saxpy,  arr_b[j] += 3 * arr_a[j]; acc += arr_b[j])
+GEN_KERNEL(gen_max,    if (arr_a[j] > acc) acc = arr_a[j]; else acc -= 1)
+GEN_KERNEL(gen_count,  if (arr_a[j] & 0x10) acc++)
+GEN_KERNEL(gen_crc,    acc = ((acc >> 1) ^ (-(acc & 1) & 0xEDB88320L)) ^ arr_a[j])
+GEN_KERNEL(gen_hash,   acc = acc * 31 + arr_a[j])
+GEN_KERNEL(gen_shift,  acc ^= ((long)arr_a[j] << (j & 7)) | (arr_b[j] >> 3))
+
+typedef struct {
+    const char *name;
+    const char *from;
+    long (*fn)(long);
+} kernel_t;
+
+static const kernel_t kernels[] = {
+    { "hot_compute_0",   "001", hot_compute_0 },
+    { "hot_compute_1",   "001", hot_compute_1 },
+    { "hot_compute_2",   "001", hot_compute_2 },
+    { "hot_compute_3",   "001", hot_compute_3 },
+    { "hot_compute",     "003", lib_hot_compute },
+    { "hot_compute_alt", "003", lib_hot_compute_alt },
+    { "gen_sum",         "gen", gen_sum },
+    { "gen_dot",         "gen", gen_dot },
+    { "gen_saxpy",       "gen", gen_saxpy },
+    { "gen_max",         "gen", gen_max },
+    { "gen_count",       "gen", gen_count },
+    { "gen_crc",         "gen", gen_crc },
+    { "gen_hash",        "gen", gen_hash },
+    { "gen_shift",       "gen", gen_shift },
+};
+#define NUM_KERNELS (int)(sizeof(kernels) / sizeof(kernels[0]))
+
+/* ── Child ───────────────────────────────────────────────────────── */
+
+typedef struct {
+    uint64_t steady_ns[NUM_KERNELS];    /* median round of the second half */
+    long sink;
+} child_result_t;
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int child_main(int fd)
+{
+    child_result_t r;
+    uint64_t round_ns[ROUNDS];
+    long sink = 0;
+
+    memset(&r, 0, sizeof(r));
+    for (int i = 0; i < ARRAY_LEN; i++) {
+        arr_a[i] = (int32_t)((i * 2654435761u) >> 8);
+        arr_b[i] = i ^ 0x55;
+    }
+
+    for (int k = 0; k < NUM_KERNELS; k++) {
+        for (int round = 0; round < ROUNDS; round++) {
+            uint64_t t0 = now_ns();
+            sink += kernels[k].fn(ITERS);
+            round_ns[round] = now_ns() - t0;
+        }
+        qsort(&round_ns[ROUNDS / 2], ROUNDS - ROUNDS / 2, sizeof(round_ns[0]), cmp_u64);
+        r.steady_ns[k] = round_ns[ROUNDS / 2 + (ROUNDS - ROUNDS / 2) / 2];
+    }
+    r.sink = sink;
+
+    if (write(fd, &r, sizeof(r)) != (ssize_t)sizeof(r))
+        return 1;
+    close(fd);
+    return 0;
+}
+
+/* ── Parent ──────────────────────────────────────────────────────── */
+
+/* Run one child with the environment as it is; -1 on failure */
+static int run_child(const char *self, child_result_t *r)
+{
+    int pfd[2];
+    char fdarg[16];
+
+    if (pipe(pfd) != 0) {
+        perror("pipe");
+        return -1;
+    }
+    snprintf(fdarg, sizeof(fdarg), "%d", pfd[1]);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        close(pfd[0]);
+        execlp(self, self, "--child", fdarg, (char *)NULL);
+        perror(self);
+        _exit(127);
+    }
+    close(pfd[1]);
+
+    size_t got = 0;
+    while (got < sizeof(*r)) {
+        ssize_t n = read(pfd[0], (char *)r + got, sizeof(*r) - got);
+        if (n <= 0)
+            break;
+        got += n;
+    }
+    close(pfd[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    if (got != sizeof(*r) || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "child failed (status 0x%x, %zu bytes)\n", status, got);
+        return -1;
+    }
+    return 0;
+}
+
+static void print_separator(void)
+{
+    printf("  +-----------------+------+-----------+-----------+---------+\n");
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc == 3 && strcmp(argv[1], "--child") == 0)
+        return child_main(atoi(argv[2]));
+
+    const char *hot_n = argc > 1 ? argv[1] : DEFAULT_HOT_N;
+
+    printf("########################################\n");
+    printf(" BENCHMARK 513: hot loop kernels and hot block rebuild\n");
+    printf("########################################\n\n");
+    printf("Kernels:  %d, %d rounds x %d iterations each (steady = median of the second half)\n",
+           NUM_KERNELS, ROUNDS, ITERS);
+    printf("Children: %d x off (BOX64_DYNAREC_HOTRECOMPILE unset), on (=%s), interleaved\n\n",
+           REPEATS, hot_n);
+
+    child_result_t off, on;
+    for (int rep = 0; rep < REPEATS; rep++) {
+        child_result_t r[2];
+        unsetenv("BOX64_DYNAREC_HOTRECOMPILE");
+        if (run_child(argv[0], &r[0]) != 0)
+            return 1;
+        setenv("BOX64_DYNAREC_HOTRECOMPILE", hot_n, 1);
+        if (run_child(argv[0], &r[1]) != 0)
+            return 1;
+        for (int k = 0; k < NUM_KERNELS; k++) {
+            if (rep == 0 || r[0].steady_ns[k] < off.steady_ns[k])
+                off.steady_ns[k] = r[0].steady_ns[k];
+            if (rep == 0 || r[1].steady_ns[k] < on.steady_ns[k])
+                on.steady_ns[k] = r[1].steady_ns[k];
+        }
+    }
+
+    print_separator();
+    printf("  | Kernel          | From | off ns/it |  on ns/it | speedup |\n");
+    print_separator();
+    double log_sum = 0;
+    for (int k = 0; k < NUM_KERNELS; k++) {
+        double a = (double)off.steady_ns[k] / ITERS, b = (double)on.steady_ns[k] / ITERS;
+        double speedup = b > 0 ? a / b : 0.0;
+        log_sum += log(speedup > 0 ? speedup : 1.0);
+        printf("  | %-15s | %-4s | %9.3f | %9.3f | %6.2fx |\n",
+               kernels[k].name, kernels[k].from, a, b, speedup);
+    }
+    print_separator();
+    printf("  | geometric mean  |      |           |           | %6.2fx |\n",
+           exp(log_sum / NUM_KERNELS));
+    print_separator();
+
+    printf("\nWithout the patch both children compile the same blocks, and the\n");
+    printf("speedup column is run-to-run noise around 1.00x.\n");
+    return 0;
+}
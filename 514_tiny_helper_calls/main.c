@@ -0,0 +1,229 @@
+/*
+ * 514_tiny_helper_calls
+ *
+ * Benchmark: loops over many tiny noinline helpers against the same work
+ * inlined
+ *
+ * Background:
+ *   A dynablock ends at the first unconditional jmp, call or ret that
+ *   leaves it ("higher max_db=33/57/90" in the dynarec log shows how
+ *   short blocks are). Each end is a trip through the jump table, and
+ *   native flags and cached SSE/x87 registers are flushed there. Code
+ *   built from tiny helpers pays this on every call and every ret.
+ *   patches/dynarec_superblock.patch adds BOX64_DYNAREC_SUPERBLOCK=<n>:
+ *   1 keeps a block going across direct jumps, 2 also through small
+ *   direct calls and their ret.
+ *
+ * What this benchmark does:
+ *   Every kernel does the same 16 UNIT() steps per iteration, in a
+ *   different shape:
+ *     inline   - all 16 inlined in the loop (the baseline)
+ *     wide     - 16 calls to distinct noinline helpers
+ *     chain    - 4 calls, each starting a nested chain 4 helpers deep
+ *     tail     - 4 calls, each starting a chain of 3 tail calls (jmp)
+ *     branchy  - 16 calls to helpers with an if/else inside (the
+ *                branch always goes the same way, so it predicts well)
+ *   After a warm-up round, it times ROUNDS rounds of iters iterations and
+ *   keeps the fastest. Reported per kernel: calls and jumps per
+ *   iteration, ns per iteration and the ratio to inline.
+ *
+ * Run:
+ *   ./514_tiny_helper_calls [iters]
+ *   BOX64_DYNAREC=1 box64 ./514_tiny_helper_calls
+ *   BOX64_DYNAREC=1 BOX64_DYNAREC_SUPERBLOCK=2 box64 ./514_tiny_helper_calls
+ *
+ *   Default: 2000000 iterations per round.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Configuration */
+#define DEFAULT_ITERS  2000000   /* Iterations per round */
+#define ROUNDS         3         /* Timed rounds per kernel; fastest kept */
+
+static volatile long sink;
+static volatile long rare_mask = 0;     /* branchy helpers: branch never taken */
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* One step of work; n makes every helper distinct */
+#define UNIT(x, n) ((x) * 3 + ((n) ^ ((x) >> 7)))
+
+/* Base-4 ids 100..133, as in 511 */
+#define L0(X, p) X(p##0) X(p##1) X(p##2) X(p##3)
+#define L1(X, p) L0(X, p##0) L0(X, p##1) L0(X, p##2) L0(X, p##3)
+
+/* ── Helpers ─────────────────────────────────────────────────────── */
+
+#define GEN_WIDE(n)                                                 \
+    __attribute__((noinline))                                       \
+    static long wide_##n(long x) { return UNIT(x, 0x##n); }
+
+#define GEN_BRANCHY(n)                                              \
+    __attribute__((noinline))                                       \
+    static long branchy_##n(long x)                                 \
+    {                                                               \
+        if (x & rare_mask)                                          \
+            x = UNIT(x, 0x##n);                                     \
+        else                                                        \
+            x = UNIT(x >> 1, 0x##n) ^ (n);                          \
+        return x;                                                   \
+    }
+
+/* Nested chain c: each helper calls the next, then works on its result */
+#define GEN_CHAIN(c)                                                \
+    __attribute__((noinline))                                       \
+    static long chain##c##_3(long x) { return UNIT(x, 0x##c##3); }  \
+    __attribute__((noinline))                                       \
+    static long chain##c##_2(long x) { return UNIT(chain##c##_3(x), 0x##c##2); } \
+    __attribute__((noinline))                                       \
+    static long chain##c##_1(long x) { return UNIT(chain##c##_2(x), 0x##c##1); } \
+    __attribute__((noinline))                                       \
+    static long chain##c##_0(long x) { return UNIT(chain##c##_1(x), 0x##c##0); }
+
+/* Tail chain c: each helper works and jumps to the next (sibling call) */
+#define GEN_TAIL(c)                                                 \
+    __attribute__((noinline))                                       \
+    static long tail##c##_3(long x) { return UNIT(x, 0x##c##3); }   \
+    __attribute__((noinline))                                       \
+    static long tail##c##_2(long x) { return tail##c##_3(UNIT(x, 0x##c##2)); } \
+    __attribute__((noinline))                                       \
+    static long tail##c##_1(long x) { return tail##c##_2(UNIT(x, 0x##c##1)); } \
+    __attribute__((noinline))                                       \
+    static long tail##c##_0(long x) { return tail##c##_1(UNIT(x, 0x##c##0)); }
+
+L1(GEN_WIDE, 1)
+L1(GEN_BRANCHY, 1)
+L0(GEN_CHAIN, 1)
+L0(GEN_TAIL, 1)
+
+/* ── Kernels ─────────────────────────────────────────────────────── */
+
+#define DO_INLINE(n)  x = UNIT(x, 0x##n);
+#define DO_WIDE(n)    x = wide_##n(x);
+#define DO_BRANCHY(n) x = branchy_##n(x);
+#define DO_CHAIN(c)   x = chain##c##_0(x);
+#define DO_TAIL(c)    x = tail##c##_0(x);
+
+__attribute__((noinline))
+static long kernel_inline(long iters)
+{
+    long x = 1;
+    for (long i = 0; i < iters; i++) {
+        L1(DO_INLINE, 1)
+    }
+    return x;
+}
+
+__attribute__((noinline))
+static long kernel_wide(long iters)
+{
+    long x = 1;
+    for (long i = 0; i < iters; i++) {
+        L1(DO_WIDE, 1)
+    }
+    return x;
+}
+
+__attribute__((noinline))
+static long kernel_chain(long iters)
+{
+    long x = 1;
+    for (long i = 0; i < iters; i++) {
+        L0(DO_CHAIN, 1)
+    }
+    return x;
+}
+
+__attribute__((noinline))
+static long kernel_tail(long iters)
+{
+    long x = 1;
+    for (long i = 0; i < iters; i++) {
+        L0(DO_TAIL, 1)
+    }
+    return x;
+}
+
+__attribute__((noinline))
+static long kernel_branchy(long iters)
+{
+    long x = 1;
+    for (long i = 0; i < iters; i++) {
+        L1(DO_BRANCHY, 1)
+    }
+    return x;
+}
+
+typedef struct {
+    const char *name;
+    long (*fn)(long);
+    int calls;      /* call + ret pairs per iteration */
+    int jumps;      /* tail-call jmps per iteration */
+} kernel_t;
+
+static const kernel_t kernels[] = {
+    { "inline",  kernel_inline,   0,  0 },
+    { "wide",    kernel_wide,    16,  0 },
+    { "chain",   kernel_chain,   16,  0 },
+    { "tail",    kernel_tail,     4, 12 },
+    { "branchy", kernel_branchy, 16,  0 },
+};
+#define NUM_KERNELS (int)(sizeof(kernels) / sizeof(kernels[0]))
+
+/* Fastest of ROUNDS timed rounds, after one warm-up round */
+static uint64_t time_kernel(const kernel_t *k, long iters)
+{
+    uint64_t best = UINT64_MAX;
+    sink += k->fn(iters / 10 + 1);
+    for (int r = 0; r < ROUNDS; r++) {
+        uint64_t t0 = now_ns();
+        sink += k->fn(iters);
+        uint64_t t = now_ns() - t0;
+        if (t < best)
+            best = t;
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    long iters = argc > 1 ? atol(argv[1]) : DEFAULT_ITERS;
+    if (iters < 1000)
+        iters = DEFAULT_ITERS;
+
+    const char *sb = getenv("BOX64_DYNAREC_SUPERBLOCK");
+
+    printf("########################################\n");
+    printf(" BENCHMARK 514: tiny helper calls\n");
+    printf("########################################\n\n");
+    printf("Work:       16 UNIT() steps per iteration, %ld iterations, best of %d rounds\n",
+           iters, ROUNDS);
+    printf("Superblock: BOX64_DYNAREC_SUPERBLOCK=%s\n\n", sb ? sb : "unset");
+
+    printf("  +----------+----------+----------+-----------+-----------+\n");
+    printf("  | Kernel   | calls/it | jumps/it |   ns/iter | vs inline |\n");
+    printf("  +----------+----------+----------+-----------+-----------+\n");
+    double base = 0;
+    for (int k = 0; k < NUM_KERNELS; k++) {
+        double ns = (double)time_kernel(&kernels[k], iters) / iters;
+        if (k == 0)
+            base = ns;
+        printf("  | %-8s | %8d | %8d | %9.2f | %8.2fx |\n", kernels[k].name,
+               kernels[k].calls, kernels[k].jumps, ns, base > 0 ? ns / base : 0.0);
+    }
+    printf("  +----------+----------+----------+-----------+-----------+\n");
+
+    printf("\nvs inline is the price of the call shape for the same work. Superblocks\n");
+    printf("should bring wide, chain and tail closer to 1.00x.\n");
+    return 0;
+}
@@ -0,0 +1,321 @@
+/*
+ * 515_code_cache_churn
+ *
+ * Benchmark: code cache fragmentation after compile/purge/recompile
+ * cycles, and what a compaction gives back
+ *
+ * Background:
+ *   box64 carves its blocks out of the chunks of the global mmaplist
+ *   (blocklist_t, a blockmark_t before every block). When code goes away
+ *   (munmap, dlclose, a purge) its blocks become holes, and later blocks
+ *   of other sizes only partly fill them. Long-lived blocks end up spread
+ *   over many half-empty chunks, so the hot code touches more pages,
+ *   iTLB entries and icache sets than its size needs.
+ *   patches/dynarec_code_cache_compact.patch adds free-space histograms
+ *   to the 001 stats dump and box64_compact() to libbox64ctl.so, which
+ *   evacuates the sparse chunks so their blocks are rebuilt at the front.
+ *
+ * What this benchmark does:
+ *   NUM_LIVE "live" functions are generated once and stay mapped. Each of
+ *   CYCLES churn cycles generates NUM_CHURN short-lived functions of a
+ *   different size into a fresh mapping, runs them once (compile), then
+ *   unmaps them (box64 frees their blocks). The first call of each live
+ *   function falls in one of the cycles, between churn calls, so the
+ *   live blocks are scattered among blocks that later go away.
+ *   Then:
+ *     before  - code cache layout (stats dump) and a live round: all
+ *               NUM_LIVE functions called in order, fastest of ROUNDS
+ *     compact - box64_compact(), then one round that rebuilds what it
+ *               evacuated (timed), then box64_compact() again, which
+ *               frees the evacuated blocks
+ *     after   - the same layout and live round as before
+ *   Generated code is checked against the same computation in C.
+ *
+ *   The layout rows need BOX64_DYNAREC_STATS (001 patch) and read "-"
+ *   without it. Without box64_compact() (native run, unpatched box64)
+ *   the after column is a second measurement of the same layout.
+ *
+ * Run:
+ *   ./515_code_cache_churn [cycles]
+ *   BOX64_DYNAREC=1 box64 ./515_code_cache_churn
+ *   BOX64_DYNAREC=1 BOX64_DYNAREC_STATS=/tmp/box64_stats.%p.json \
+ *       box64 ./515_code_cache_churn
+ *
+ *   Default: 8 churn cycles.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "../common/box64_stats.h"
+#include "../common/box64ctl.h"
+
+/* Configuration */
+#define NUM_LIVE        4000    /* Long-lived generated functions */
+#define NUM_CHURN       4000    /* Short-lived functions per churn cycle */
+#define DEFAULT_CYCLES  8       /* Compile/unmap cycles */
+#define MAX_CYCLES      64
+#define FUNC_SLOT       256     /* Bytes reserved per generated function */
+#define LIVE_UNITS      4       /* imul/add pairs in a live function */
+#define ROUNDS          20      /* Timed live rounds per measurement; fastest kept */
+
+/* imul/add pairs of the churn functions, per cycle: sizes that do not fit
+ * each other's holes */
+static const int churn_units[] = { 2, 9, 5, 14, 3, 11, 7, 16 };
+#define NUM_CHURN_UNITS (int)(sizeof(churn_units) / sizeof(churn_units[0]))
+
+typedef uint64_t (*gen_func_t)(uint64_t);
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* ── Generated code ──────────────────────────────────────────────── */
+
+/* Per-function constants; all below 2^31, so sign extension is a no-op */
+static uint32_t gen_k(uint32_t i, uint32_t salt)
+{
+    return ((i + 1) * 2654435761u ^ salt) & 0x7fffffff;
+}
+
+/*
+ * Function i, in x86-64, one block:
+ *   48 89 f8              mov  rax, rdi
+ *   units times:
+ *     48 69 c0 k1         imul rax, rax, k1
+ *     48 05 k2            add  rax, k2
+ *   48 c1 e8 03           shr  rax, 3
+ *   c3                    ret
+ * padded with int3 to FUNC_SLOT. k1 and k2 change with i, salt and the
+ * unit.
+ */
+static void emit_func(uint8_t *p, uint32_t i, uint32_t salt, int units)
+{
+    uint8_t *q = p;
+
+    memset(p, 0xcc, FUNC_SLOT);
+    *q++ = 0x48; *q++ = 0x89; *q++ = 0xf8;
+    for (int u = 0; u < units; u++) {
+        uint32_t k1 = gen_k(i, salt + u) | 1, k2 = gen_k(i, salt ^ (u << 20));
+        *q++ = 0x48; *q++ = 0x69; *q++ = 0xc0; memcpy(q, &k1, 4); q += 4;
+        *q++ = 0x48; *q++ = 0x05; memcpy(q, &k2, 4); q += 4;
+    }
+    *q++ = 0x48; *q++ = 0xc1; *q++ = 0xe8; *q++ = 0x03;
+    *q++ = 0xc3;
+}
+
+/* The same computation in C, to check the generated code */
+static uint64_t func_ref(uint32_t i, uint32_t salt, int units, uint64_t x)
+{
+    for (int u = 0; u < units; u++)
+        x = x * (gen_k(i, salt + u) | 1) + gen_k(i, salt ^ (u << 20));
+    return x >> 3;
+}
+
+/* NUM functions of the given size in a fresh executable mapping */
+static uint8_t *map_funcs(int num, uint32_t salt, int units)
+{
+    size_t size = (size_t)num * FUNC_SLOT;
+    uint8_t *code = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+        perror("mmap");
+        return NULL;
+    }
+    for (int i = 0; i < num; i++)
+        emit_func(code + (size_t)i * FUNC_SLOT, i, salt, units);
+    if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
+        perror("mprotect");
+        munmap(code, size);
+        return NULL;
+    }
+    return code;
+}
+
+#define LIVE_SALT 0x5eed
+#define FUNC(code, i) ((gen_func_t)((code) + (size_t)(i) * FUNC_SLOT))
+
+/* ── Churn ───────────────────────────────────────────────────────── */
+
+/*
+ * Cycle c: NUM_CHURN new functions run once, with the first call of the
+ * live functions i % cycles == c in between, then the mapping goes away.
+ * Returns 0, or -1 on a mapping failure or a wrong result.
+ */
+static int churn_cycle(uint8_t *live, int c, int cycles)
+{
+    int units = churn_units[c % NUM_CHURN_UNITS];
+    uint32_t salt = 0x1000 * (c + 1);
+    uint8_t *code = map_funcs(NUM_CHURN, salt, units);
+    if (!code)
+        return -1;
+
+    uint64_t x = 1, ref = 1;
+    int next_live = c;
+    for (int i = 0; i < NUM_CHURN; i++) {
+        x = FUNC(code, i)(x);
+        ref = func_ref(i, salt, units, ref);
+        /* spread this cycle's live functions evenly over the churn calls */
+        while (next_live < NUM_LIVE && (long)next_live * NUM_CHURN < (long)i * NUM_LIVE) {
+            x = FUNC(live, next_live)(x);
+            ref = func_ref(next_live, LIVE_SALT, LIVE_UNITS, ref);
+            next_live += cycles;
+        }
+    }
+    for (; next_live < NUM_LIVE; next_live += cycles) {
+        x = FUNC(live, next_live)(x);
+        ref = func_ref(next_live, LIVE_SALT, LIVE_UNITS, ref);
+    }
+    munmap(code, (size_t)NUM_CHURN * FUNC_SLOT);
+    return x == ref ? 0 : -1;
+}
+
+/* ── Live rounds ─────────────────────────────────────────────────── */
+
+static uint64_t live_round(uint8_t *live, uint64_t x)
+{
+    for (int i = 0; i < NUM_LIVE; i++)
+        x = FUNC(live, i)(x);
+    return x;
+}
+
+/* Fastest of ROUNDS live rounds, in ns per call; *ok = 0 on a mismatch */
+static double time_live(uint8_t *live, uint64_t ref, int *ok)
+{
+    uint64_t best = UINT64_MAX;
+    for (int r = 0; r < ROUNDS; r++) {
+        uint64_t t0 = now_ns();
+        uint64_t x = live_round(live, 1);
+        uint64_t t = now_ns() - t0;
+        if (x != ref)
+            *ok = 0;
+        if (t < best)
+            best = t;
+    }
+    return (double)best / NUM_LIVE;
+}
+
+/* ── Code cache layout ───────────────────────────────────────────── */
+
+typedef struct {
+    long chunks;
+    long alloc_bytes;
+    long free_bytes;
+    long free_blocks;
+    long largest_free;
+    long frag_permille;
+    long live_pages;
+} layout_t;
+
+static int read_layout(layout_t *l)
+{
+    char *json = box64_stats_snapshot();
+    if (!json)
+        return -1;
+    l->chunks = 0;
+    for (const char *p = json; (p = strstr(p, "\"start\":")) != NULL; p++)
+        l->chunks++;
+    l->alloc_bytes = box64_stats_get(json, "alloc_bytes");
+    l->free_bytes = box64_stats_get(json, "free_bytes");
+    l->free_blocks = box64_stats_get(json, "free_blocks");
+    l->largest_free = box64_stats_get(json, "largest_free");
+    l->frag_permille = box64_stats_get(json, "frag_permille");
+    l->live_pages = box64_stats_get(json, "live_pages");
+    free(json);
+    return 0;
+}
+
+static void print_row(const char *name, long before, long after, int have)
+{
+    if (!have || before < 0 || after < 0)
+        printf("  | %-18s | %10s | %10s |\n", name, "-", "-");
+    else
+        printf("  | %-18s | %10ld | %10ld |\n", name, before, after);
+}
+
+int main(int argc, char *argv[])
+{
+    int cycles = argc > 1 ? atoi(argv[1]) : DEFAULT_CYCLES;
+    if (cycles < 1 || cycles > MAX_CYCLES)
+        cycles = DEFAULT_CYCLES;
+
+    printf("########################################\n");
+    printf(" BENCHMARK 515: code cache churn and compaction\n");
+    printf("########################################\n\n");
+
+    int use_stats = box64_stats_enabled();
+    printf("Live:     %d functions of %d units, kept mapped\n", NUM_LIVE, LIVE_UNITS);
+    printf("Churn:    %d cycles x %d functions, compiled once then unmapped\n", cycles, NUM_CHURN);
+    printf("Stats:    %s\n", use_stats ? "BOX64_DYNAREC_STATS (code cache layout)"
+                                       : "off (set BOX64_DYNAREC_STATS for the layout rows)");
+
+    uint8_t *live = map_funcs(NUM_LIVE, LIVE_SALT, LIVE_UNITS);
+    if (!live)
+        return 1;
+    uint64_t ref = 1;
+    for (int i = 0; i < NUM_LIVE; i++)
+        ref = func_ref(i, LIVE_SALT, LIVE_UNITS, ref);
+
+    uint64_t t0 = now_ns();
+    for (int c = 0; c < cycles; c++) {
+        if (churn_cycle(live, c, cycles) != 0) {
+            printf("\nERROR: churn cycle %d failed (mapping or wrong result)\n", c);
+            return 1;
+        }
+    }
+    printf("Time:     %.1f ms for the churn\n\n", (now_ns() - t0) / 1e6);
+
+    int ok = 1;
+    layout_t before, after;
+    memset(&before, -1, sizeof(before));
+    memset(&after, -1, sizeof(after));
+    int have = use_stats && read_layout(&before) == 0;
+    double ns_before = time_live(live, ref, &ok);
+
+    t0 = now_ns();
+    int evacuated = box64ctl_compact();
+    uint64_t x = live_round(live, 1);
+    double rebuild_ms = (now_ns() - t0) / 1e6;
+    if (x != ref)
+        ok = 0;
+    /* the first call only queued them: this one frees them */
+    box64ctl_compact();
+
+    have = have && read_layout(&after) == 0;
+    double ns_after = time_live(live, ref, &ok);
+
+    if (evacuated < 0)
+        printf("Compact:  box64_compact() not answered (native run or unpatched box64)\n\n");
+    else
+        printf("Compact:  box64_compact() evacuated %d blocks, rebuild round %.1f ms\n\n",
+               evacuated, rebuild_ms);
+
+    printf("  +--------------------+------------+------------+\n");
+    printf("  | Code cache         |     before |      after |\n");
+    printf("  +--------------------+------------+------------+\n");
+    print_row("chunks", before.chunks, after.chunks, have);
+    print_row("alloc_bytes", before.alloc_bytes, after.alloc_bytes, have);
+    print_row("free_bytes", before.free_bytes, after.free_bytes, have);
+    print_row("free_blocks", before.free_blocks, after.free_blocks, have);
+    print_row("largest_free", before.largest_free, after.largest_free, have);
+    print_row("frag_permille", before.frag_permille, after.frag_permille, have);
+    print_row("live_pages", before.live_pages, after.live_pages, have);
+    printf("  +--------------------+------------+------------+\n");
+    printf("  | live ns/call       | %10.2f | %10.2f |\n", ns_before, ns_after);
+    printf("  +--------------------+------------+------------+\n");
+
+    if (!ok) {
+        printf("\nERROR: generated code returned a wrong result\n");
+        return 1;
+    }
+    printf("\nCompaction should cut free_blocks, frag_permille and live_pages; live\n");
+    printf("ns/call is what the scattered layout costs the live code.\n");
+    return 0;
+}
@@ -0,0 +1,302 @@
+/*
+ * 516_hot_small_blocks
+ *
+ * Benchmark: call throughput over thousands of small hot blocks, and code
+ * cache density, with block metadata inside and outside the code cache
+ *
+ * Background:
+ *   box64 lays out each block as one code cache allocation: native code,
+ *   Table64, JmpNext, InstSize, arch data, CallRet data, the dynablock_t
+ *   and relocation data (docs/HOW_BOX64_WORKS.md, "Block Memory Layout").
+ *   Only the first three are used while the code runs. For a small block
+ *   the cold rest is often bigger than the code, so hot small blocks are
+ *   spread over more icache lines and pages than their code needs.
+ *   patches/dynarec_cold_metadata.patch moves the cold part to a separate
+ *   allocation when BOX64_DYNAREC_COLDMETA=1; by default it keeps the
+ *   single one.
+ *
+ * What this benchmark does:
+ *   The benchmark re-executes itself as a child (argv[0] --child), in
+ *   REPEATS pairs: one child with BOX64_DYNAREC_COLDMETA unset ("inline")
+ *   and one with BOX64_DYNAREC_COLDMETA=1 ("split"), interleaved so CPU
+ *   frequency and load changes hit both sides. The child generates
+ *   NUM_FUNCS small functions at run time (one block each) and calls
+ *   every one once, so consecutive functions get consecutive blocks.
+ *   Then, for each working set size, it calls the first n functions
+ *   round-robin, CALLS calls per round, and keeps the fastest of ROUNDS
+ *   rounds.
+ *   Reported per working set: Mcalls/s on both sides and the speedup
+ *   (fastest child of each side). When libbox64ctl answers
+ *   (box64ctl_wrapped_lib.patch), the code cache bytes per block and the
+ *   share of them that is native code, from box64_stats() around the
+ *   first pass.
+ *   Generated code is checked against the same computation in C.
+ *
+ * Run:
+ *   ./516_hot_small_blocks
+ *   BOX64_DYNAREC=1 box64 ./516_hot_small_blocks
+ *
+ *   Without the patch both children build the same layout and the
+ *   speedup is noise around 1.00x.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#include "../common/box64ctl.h"
+
+/* Configuration */
+#define NUM_FUNCS   16384       /* Generated functions, one small block each */
+#define FUNC_SLOT   32          /* Bytes reserved per generated function */
+#define CALLS       2000000     /* Calls per timed round */
+#define ROUNDS      5           /* Timed rounds per working set; fastest kept */
+#define REPEATS     3           /* inline/split child pairs; fastest kept */
+
+static const int working_sets[] = { 256, 1024, 4096, 16384 };
+#define NUM_SETS (int)(sizeof(working_sets) / sizeof(working_sets[0]))
+
+typedef uint64_t (*gen_func_t)(uint64_t);
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* ── Generated code ──────────────────────────────────────────────── */
+
+/* Per-function constants; all below 2^31, so sign extension is a no-op */
+static uint32_t gen_k(uint32_t i, uint32_t salt)
+{
+    return ((i + 1) * 2654435761u ^ salt) & 0x7fffffff;
+}
+
+/*
+ * Function i, in x86-64, one block of four instructions:
+ *   48 89 f8              mov  rax, rdi
+ *   48 05 k1              add  rax, k1
+ *   48 35 k2              xor  rax, k2
+ *   c3                    ret
+ * padded with int3 to FUNC_SLOT.
+ */
+static void emit_func(uint8_t *p, uint32_t i)
+{
+    uint32_t k1 = gen_k(i, 0x2468ace), k2 = gen_k(i, 0x13579bd);
+    uint8_t *q = p;
+
+    memset(p, 0xcc, FUNC_SLOT);
+    *q++ = 0x48; *q++ = 0x89; *q++ = 0xf8;
+    *q++ = 0x48; *q++ = 0x05; memcpy(q, &k1, 4); q += 4;
+    *q++ = 0x48; *q++ = 0x35; memcpy(q, &k2, 4); q += 4;
+    *q++ = 0xc3;
+}
+
+/* The same computation in C, to check the generated code */
+static uint64_t func_ref(uint32_t i, uint64_t x)
+{
+    return (x + gen_k(i, 0x2468ace)) ^ gen_k(i, 0x13579bd);
+}
+
+#define FUNC(code, i) ((gen_func_t)((code) + (size_t)(i) * FUNC_SLOT))
+
+/* ── Child ───────────────────────────────────────────────────────── */
+
+typedef struct {
+    uint64_t best_ns[NUM_SETS];     /* fastest round of CALLS calls */
+    int64_t blocks;                 /* box64_stats() delta of the first pass, */
+    int64_t alloc_bytes;            /* -1 when libbox64ctl does not answer */
+    int64_t code_bytes;
+    int mismatch;
+    uint64_t sink;
+} child_result_t;
+
+static uint64_t run_set(uint8_t *code, int n, long calls)
+{
+    uint64_t x = 1;
+    for (long done = 0; done < calls; done += n)
+        for (int i = 0; i < n; i++)
+            x = FUNC(code, i)(x);
+    return x;
+}
+
+static int child_main(int fd)
+{
+    child_result_t r;
+    size_t size = (size_t)NUM_FUNCS * FUNC_SLOT;
+
+    memset(&r, 0, sizeof(r));
+    uint8_t *code = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    for (uint32_t i = 0; i < NUM_FUNCS; i++)
+        emit_func(code + (size_t)i * FUNC_SLOT, i);
+    if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
+        perror("mprotect");
+        return 1;
+    }
+
+    /* first pass: one block per function, in order */
+    box64ctl_stats_t before, after;
+    int have = box64ctl_stats(&before) == 0;
+    uint64_t x = 1, ref = 1;
+    for (uint32_t i = 0; i < NUM_FUNCS; i++) {
+        x = FUNC(code, i)(x);
+        ref = func_ref(i, ref);
+    }
+    r.mismatch = x != ref;
+    have = have && box64ctl_stats(&after) == 0;
+    r.blocks = have ? (int64_t)(after.total_blocks - before.total_blocks) : -1;
+    r.alloc_bytes = have ? (int64_t)(after.alloc_bytes - before.alloc_bytes) : -1;
+    r.code_bytes = have ? (int64_t)(after.code_bytes - before.code_bytes) : -1;
+
+    for (int s = 0; s < NUM_SETS; s++) {
+        r.best_ns[s] = UINT64_MAX;
+        r.sink += run_set(code, working_sets[s], working_sets[s]);
+        for (int round = 0; round < ROUNDS; round++) {
+            uint64_t t0 = now_ns();
+            r.sink += run_set(code, working_sets[s], CALLS);
+            uint64_t t = now_ns() - t0;
+            if (t < r.best_ns[s])
+                r.best_ns[s] = t;
+        }
+    }
+
+    if (write(fd, &r, sizeof(r)) != (ssize_t)sizeof(r))
+        return 1;
+    close(fd);
+    return 0;
+}
+
+/* ── Parent ──────────────────────────────────────────────────────── */
+
+/* Run one child with the environment as it is; -1 on failure */
+static int run_child(const char *self, child_result_t *r)
+{
+    int pfd[2];
+    char fdarg[16];
+
+    if (pipe(pfd) != 0) {
+        perror("pipe");
+        return -1;
+    }
+    snprintf(fdarg, sizeof(fdarg), "%d", pfd[1]);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        close(pfd[0]);
+        execlp(self, self, "--child", fdarg, (char *)NULL);
+        perror(self);
+        _exit(127);
+    }
+    close(pfd[1]);
+
+    size_t got = 0;
+    while (got < sizeof(*r)) {
+        ssize_t n = read(pfd[0], (char *)r + got, sizeof(*r) - got);
+        if (n <= 0)
+            break;
+        got += n;
+    }
+    close(pfd[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    if (got != sizeof(*r) || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "child failed (status 0x%x, %zu bytes)\n", status, got);
+        return -1;
+    }
+    return 0;
+}
+
+/* Calls per round actually made for working set s (whole passes) */
+static long set_calls(int s)
+{
+    long n = working_sets[s];
+    return (CALLS + n - 1) / n * n;
+}
+
+static void fmt_density(char *per_block, char *share, size_t size, const child_result_t *r)
+{
+    snprintf(per_block, size, "-");
+    snprintf(share, size, "-");
+    if (r->blocks <= 0 || r->alloc_bytes <= 0 || r->code_bytes < 0)
+        return;
+    snprintf(per_block, size, "%.1f", (double)r->alloc_bytes / r->blocks);
+    snprintf(share, size, "%.1f%%", 100.0 * r->code_bytes / r->alloc_bytes);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc == 3 && strcmp(argv[1], "--child") == 0)
+        return child_main(atoi(argv[2]));
+
+    printf("########################################\n");
+    printf(" BENCHMARK 516: hot small blocks and cold block metadata\n");
+    printf("########################################\n\n");
+    printf("Functions: %d generated, one small block each\n", NUM_FUNCS);
+    printf("Rounds:    %d calls, fastest of %d per working set\n", CALLS, ROUNDS);
+    printf("Children:  %d x inline (BOX64_DYNAREC_COLDMETA unset), split (=1), interleaved\n\n",
+           REPEATS);
+
+    child_result_t side[2];
+    for (int rep = 0; rep < REPEATS; rep++) {
+        for (int k = 0; k < 2; k++) {
+            child_result_t r;
+            if (k == 0)
+                unsetenv("BOX64_DYNAREC_COLDMETA");
+            else
+                setenv("BOX64_DYNAREC_COLDMETA", "1", 1);
+            if (run_child(argv[0], &r) != 0)
+                return 1;
+            if (r.mismatch) {
+                printf("ERROR: generated code returned a wrong result\n");
+                return 1;
+            }
+            if (rep == 0)
+                side[k] = r;
+            for (int s = 0; s < NUM_SETS; s++)
+                if (r.best_ns[s] < side[k].best_ns[s])
+                    side[k].best_ns[s] = r.best_ns[s];
+        }
+    }
+
+    printf("  +----------+----------------+----------------+---------+\n");
+    printf("  | Blocks   | inline Mcall/s |  split Mcall/s | speedup |\n");
+    printf("  +----------+----------------+----------------+---------+\n");
+    for (int s = 0; s < NUM_SETS; s++) {
+        double a = set_calls(s) / (side[0].best_ns[s] / 1e3);
+        double b = set_calls(s) / (side[1].best_ns[s] / 1e3);
+        printf("  | %8d | %14.1f | %14.1f | %6.2fx |\n", working_sets[s], a, b, a > 0 ? b / a : 0.0);
+    }
+    printf("  +----------+----------------+----------------+---------+\n\n");
+
+    char pb[2][24], sh[2][24];
+    for (int k = 0; k < 2; k++)
+        fmt_density(pb[k], sh[k], sizeof(pb[k]), &side[k]);
+    printf("  +-------------------------+------------+------------+\n");
+    printf("  | Code cache              |     inline |      split |\n");
+    printf("  +-------------------------+------------+------------+\n");
+    printf("  | bytes per block         | %10s | %10s |\n", pb[0], pb[1]);
+    printf("  | native code share       | %10s | %10s |\n", sh[0], sh[1]);
+    printf("  +-------------------------+------------+------------+\n");
+    if (side[0].blocks < 0)
+        printf("  (libbox64ctl not answered: native run or box64 without box64ctl)\n");
+
+    printf("\nThe split should raise the native code share and help most once the\n");
+    printf("working set no longer fits the icache with the metadata inline.\n");
+    return 0;
+}
@@ -0,0 +1,63 @@
+/*
+ * box64_shm_stats.h - Layout of box64's live counter segment
+ *
+ * Works with patches/box64top_shm_stats.patch. When box64 runs with
+ *
+ *   BOX64_SHM_STATS=1
+ *
+ * each process maps a box64_shm_stats_t at /dev/shm/box64-<pid> (POSIX
+ * shm name "/box64-<pid>") and keeps it up to date while it runs. A
+ * reader maps it read-only and never has to signal or stop the process;
+ * tools/box64top does exactly that.
+ *
+ * All fields are 64-bit and updated with relaxed atomic adds at the site
+ * of each event: gauges go up and down, event counters only ever
+ * increase. `valid` says which fields this box64 actually fills - a
+ * reader shows the others as unknown.
+ *
+ * Must stay in sync with src/include/shmstats.h in the patch.
+ */
+
+#ifndef BOX64_SHM_STATS_H
+#define BOX64_SHM_STATS_H
+
+#include <stdint.h>
+
+#define BOX64_SHM_PREFIX  "/box64-"
+#define BOX64_SHM_MAGIC   0x5441545334364258ULL   /* "XB64STAT" */
+#define BOX64_SHM_VERSION 1
+
+/* Bits of box64_shm_stats_t.valid */
+#define BOX64_SHM_F_BLOCKS    (1u << 0)   /* blocks .. hot_page_blocks */
+#define BOX64_SHM_F_COMPILED  (1u << 1)   /* blocks_compiled, compile_ns */
+#define BOX64_SHM_F_PURGES    (1u << 2)
+#define BOX64_SHM_F_SMC       (1u << 3)
+#define BOX64_SHM_F_BRIDGE    (1u << 4)
+#define BOX64_SHM_F_SYSCALLS  (1u << 5)
+#define BOX64_SHM_F_FORKS     (1u << 6)
+
+typedef struct {
+    uint64_t magic;            /* BOX64_SHM_MAGIC once the segment is ready */
+    uint32_t version;
+    uint32_t pid;
+    uint64_t valid;            /* BOX64_SHM_F_* */
+    uint64_t update_ns;        /* CLOCK_MONOTONIC when the segment was created */
+    char     name[64];         /* program basename */
+
+    /* Gauges */
+    uint64_t blocks;           /* dynablocks built and not freed yet */
+    uint64_t alloc_bytes;      /* their requested sizes in the code cache */
+    uint64_t code_bytes;       /* sum of native_size */
+    uint64_t hot_page_blocks;  /* built with always_test */
+
+    /* Event counters */
+    uint64_t blocks_compiled;
+    uint64_t compile_ns;
+    uint64_t purges;
+    uint64_t smc_faults;
+    uint64_t bridge_calls;
+    uint64_t syscalls;
+    uint64_t forks;
+} box64_shm_stats_t;
+
+#endif /* BOX64_SHM_STATS_H */
@@ -0,0 +1,172 @@
+/*
+ * box64_stats.h - Read the dynarec statistics JSON from inside a test
+ *
+ * Works with patches/001_dynarec_stats_json.patch. When box64 runs with
+ *
+ *   BOX64_DYNAREC_STATS=/tmp/box64_stats.%p.json
+ *
+ * it writes the stats for the current process to that file ("%p" = pid)
+ * at exit, after fork() in the child, and whenever it gets SIGUSR2.
+ * box64_stats_snapshot() raises SIGUSR2 and waits for the new file, so a
+ * test can assert on real emulator state at any point.
+ *
+ * Only set BOX64_DYNAREC_STATS when running under a patched box64: in a
+ * native run (or an unpatched box64) SIGUSR2 would kill the process.
+ *
+ * Header-only; include it from a test's main.c.
+ */
+
+#ifndef BOX64_STATS_H
+#define BOX64_STATS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+
+#define BOX64_STATS_ENV        "BOX64_DYNAREC_STATS"
+#define BOX64_STATS_MAX_SIZE   (1 << 20)
+#define BOX64_STATS_TIMEOUT_MS 2000
+
+static inline int box64_stats_enabled(void)
+{
+    const char *p = getenv(BOX64_STATS_ENV);
+    return p && *p;
+}
+
+/* Expand "%p" in $BOX64_DYNAREC_STATS for the given pid */
+static inline void box64_stats_path(char *buf, size_t size, pid_t pid)
+{
+    const char *s = getenv(BOX64_STATS_ENV);
+    size_t n = 0;
+
+    for (; s && *s && n + 16 < size; ) {
+        if (s[0] == '%' && s[1] == 'p') {
+            n += snprintf(buf + n, size - n, "%d", (int)pid);
+            s += 2;
+        } else {
+            buf[n++] = *s++;
+        }
+    }
+    buf[n] = '\0';
+}
+
+/* Read the whole stats file for pid; returns a malloc'ed string or NULL */
+static inline char *box64_stats_read(pid_t pid)
+{
+    char path[4096];
+    box64_stats_path(path, sizeof(path), pid);
+
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return NULL;
+    char *json = malloc(BOX64_STATS_MAX_SIZE);
+    size_t len = json ? fread(json, 1, BOX64_STATS_MAX_SIZE - 1, f) : 0;
+    fclose(f);
+    if (json)
+        json[len] = '\0';
+    return json;
+}
+
+/*
+ * Ask box64 for a fresh dump of this process and return it (malloc'ed),
+ * or NULL if none shows up within BOX64_STATS_TIMEOUT_MS.
+ */
+static inline char *box64_stats_snapshot(void)
+{
+    char path[4096];
+    box64_stats_path(path, sizeof(path), getpid());
+    unlink(path);
+
+    raise(SIGUSR2);
+
+    struct timespec ts = { 0, 10 * 1000000L };
+    for (int waited = 0; waited < BOX64_STATS_TIMEOUT_MS; waited += 10) {
+        if (access(path, R_OK) == 0)
+            return box64_stats_read(getpid());
+        nanosleep(&ts, NULL);
+    }
+    return NULL;
+}
+
+/*
+ * Value of key in the JSON object that starts at obj (its '{'), or NULL.
+ * Only the object's own keys match: the keys of nested objects and
+ * arrays, string values and keys that merely contain key are skipped.
+ * The dump never escapes quotes, so a string ends at the next '"'.
+ */
+static inline const char *box64_stats_find(const char *obj, const char *key)
+{
+    size_t len = strlen(key);
+    int depth = 0;
+
+    for (const char *p = obj; p && *p; p++) {
+        if (*p == '{' || *p == '[') {
+            depth++;
+        } else if (*p == '}' || *p == ']') {
+            if (--depth == 0)
+                return NULL;
+        } else if (*p == '"') {
+            const char *end = strchr(p + 1, '"');
+            if (!end)
+                return NULL;
+            if (depth == 1 && (size_t)(end - p - 1) == len && !strncmp(p + 1, key, len)) {
+                const char *v = end + 1;
+                while (*v == ' ')
+                    v++;
+                if (*v == ':')
+                    return v + 1;
+            }
+            p = end;
+        }
+    }
+    return NULL;
+}
+
+/* Value of a top-level integer field, or -1 if it is missing */
+static inline long box64_stats_get(const char *json, const char *key)
+{
+    const char *v = box64_stats_find(json ? strchr(json, '{') : NULL, key);
+    return v ? strtol(v, NULL, 10) : -1;
+}
+
+/*
+ * Value of an integer field of one "mappings" entry ("global" for the
+ * global mmaplist, else the library file name), or -1 if it is missing
+ */
+static inline long box64_stats_get_mapping(const char *json, const char *name, const char *key)
+{
+    const char *p = box64_stats_find(json ? strchr(json, '{') : NULL, "mappings");
+    size_t len = strlen(name);
+
+    p = p ? strchr(p, '[') : NULL;
+    if (!p)
+        return -1;
+    /* each entry is an object at depth 1 of the array */
+    int depth = 0;
+    for (; *p; p++) {
+        if (*p == '"') {
+            p = strchr(p + 1, '"');
+            if (!p)
+                return -1;
+        } else if (*p == '[' || *p == '{') {
+            if (++depth == 2 && *p == '{') {
+                const char *v = box64_stats_find(p, "name");
+                while (v && *v == ' ')
+                    v++;
+                if (v && *v == '"' && !strncmp(v + 1, name, len) && v[1 + len] == '"') {
+                    v = box64_stats_find(p, key);
+                    return v ? strtol(v, NULL, 10) : -1;
+                }
+            }
+        } else if (*p == ']' || *p == '}') {
+            if (--depth == 0)
+                return -1;
+        }
+    }
+    return -1;
+}
+
+#endif /* BOX64_STATS_H */
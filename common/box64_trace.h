@@ -0,0 +1,65 @@
+/*
+ * box64_trace.h - File format of box64's dynarec event trace
+ *
+ * Works with patches/dynarec_trace_ring.patch. When box64 runs with
+ *
+ *   BOX64_DYNAREC_TRACE_RING=/tmp/box64_trace.%p.bin
+ *
+ * every thread records timestamped events into its own ring, and at exit
+ * the process writes ("%p" = pid):
+ *
+ *   box64_trace_header_t
+ *   nthreads x { box64_trace_thread_t, count x box64_trace_event_t }
+ *
+ * Events of a thread are oldest first. Timestamps are CLOCK_MONOTONIC,
+ * so the files of a parent and its forked children share one timeline.
+ * All fields are little-endian, as written by the ARM64 host.
+ *
+ * Must stay in sync with src/include/dyntrace.h in the patch.
+ */
+
+#ifndef BOX64_TRACE_H
+#define BOX64_TRACE_H
+
+#include <stdint.h>
+
+#define BOX64_TRACE_MAGIC   0x4543415254343642ULL   /* "B64TRACE" */
+#define BOX64_TRACE_VERSION 1
+
+enum {
+    BOX64_TRACE_COMPILE_START = 1,  /* addr = x86 address */
+    BOX64_TRACE_COMPILE_END,        /* addr, size = x86 size, extra = native size (0, 0 if aborted) */
+    BOX64_TRACE_LINK,               /* addr = x86 target, size = its x86 size, extra = native size */
+    BOX64_TRACE_INVALIDATE,         /* addr, size = x86 range, extra = 1 if destroyed, 0 if marked */
+    BOX64_TRACE_PURGE,              /* addr, size = x86 size, extra = native size */
+    BOX64_TRACE_FORK,               /* addr = parent pid in the child, 0 in the parent */
+    BOX64_TRACE_MAP_ADD,            /* addr = mmaplist, size = chunks */
+    BOX64_TRACE_MAP_DEL,            /* addr = mmaplist, size = chunks */
+    BOX64_TRACE_NTYPES
+};
+
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t pid;
+    uint64_t start_ns;      /* CLOCK_MONOTONIC at init (or fork) */
+    uint32_t nthreads;
+    uint32_t pad;
+} box64_trace_header_t;
+
+typedef struct {
+    uint32_t tid;
+    uint32_t count;         /* events that follow */
+    uint64_t dropped;       /* overwritten when the ring wrapped */
+} box64_trace_thread_t;
+
+typedef struct {
+    uint64_t ts_ns;
+    uint64_t addr;
+    uint32_t size;
+    uint32_t extra;
+    uint32_t type;
+    uint32_t pad;
+} box64_trace_event_t;
+
+#endif /* BOX64_TRACE_H */
@@ -0,0 +1,161 @@
+/*
+ * box64ctl.h - Query and control the emulator from inside a test
+ *
+ * libbox64ctl.so is a pseudo-library. Under a box64 built with
+ * patches/box64ctl_wrapped_lib.patch it is a wrapped library, and the
+ * calls reach box64's native side directly. Everywhere else (native runs,
+ * unpatched box64) the x86_64 stub from common/box64ctl/ answers, or the
+ * library is missing; either way every call returns -1.
+ *
+ * Library API (link with -lbox64ctl, or use the box64ctl_* helpers):
+ *
+ *   int box64_stats(box64ctl_stats_t *s);
+ *       Fill s with a snapshot of the dynarec block counters.
+ *   int box64_purge(void);
+ *       Invalidate every dynablock nobody is running (in_used == 0): it
+ *       leaves the jump table at once and is rebuilt on its next run. The
+ *       memory is freed by the next box64_purge(), for the blocks still
+ *       unused by then. Returns the number of blocks invalidated (queued
+ *       for that free).
+ *   int box64_block_info(const void *addr, box64ctl_block_t *b);
+ *       Describe the dynablock covering x86 address addr.
+ *       Returns 0 if found, 1 if addr has no block.
+ *   int box64_compact(void);
+ *       Evacuate sparse code cache chunks: their blocks with in_used == 0
+ *       are invalidated and rebuilt elsewhere on their next run, and the
+ *       next call frees them if they are still unused. Needs
+ *       patches/dynarec_code_cache_compact.patch on top.
+ *       Returns the number of blocks evacuated.
+ *
+ * The box64ctl_* inline helpers below dlopen() the library on first use,
+ * so a test needs no link-time dependency and still runs natively. They
+ * try $BOX64CTL_LIB if set, then the plain name (which a patched box64
+ * wraps), then libbox64ctl.so in the directory of the test binary, where
+ * the root Makefile puts the native stub.
+ * Snapshot before and after a measured region and subtract to get the
+ * emulator's work for that region.
+ *
+ * All struct fields are 64-bit, so the layout is the same on x86_64 and
+ * on the native side of box64.
+ */
+
+#ifndef BOX64CTL_H
+#define BOX64CTL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dlfcn.h>
+
+#define BOX64CTL_LIBNAME "libbox64ctl.so"
+#define BOX64CTL_ENV     "BOX64CTL_LIB"
+
+typedef struct {
+    uint64_t total_blocks;      /* dynablocks in the code cache */
+    uint64_t done_blocks;       /* ... that finished compiling */
+    uint64_t alloc_bytes;       /* code cache bytes they occupy */
+    uint64_t code_bytes;        /* native code (sum of native_size) */
+    uint64_t x64_bytes;         /* x86 code covered */
+    uint64_t pinned_blocks;     /* in_used > 0 */
+    uint64_t in_used_sum;
+    uint64_t hot_page_blocks;   /* built with always_test */
+} box64ctl_stats_t;
+
+typedef struct {
+    uint64_t x64_addr;          /* first x86 byte of the block */
+    uint64_t x64_size;
+    uint64_t native_size;
+    int64_t  in_used;           /* threads currently inside */
+    uint64_t hot_page;          /* 1 if built with always_test */
+} box64ctl_block_t;
+
+int box64_stats(box64ctl_stats_t *s);
+int box64_purge(void);
+int box64_block_info(const void *addr, box64ctl_block_t *b);
+int box64_compact(void);
+
+/* ── dlopen() helpers ────────────────────────────────────────────── */
+
+typedef struct {
+    int loaded;
+    int (*stats)(box64ctl_stats_t *);
+    int (*purge)(void);
+    int (*block_info)(const void *, box64ctl_block_t *);
+    int (*compact)(void);
+} box64ctl_api_t;
+
+/* $BOX64CTL_LIB, the plain name, then next to the test binary */
+static inline void *box64ctl_dlopen(void)
+{
+    const char *env = getenv(BOX64CTL_ENV);
+    if (env && *env)
+        return dlopen(env, RTLD_NOW);
+
+    void *h = dlopen(BOX64CTL_LIBNAME, RTLD_NOW);
+    if (h)
+        return h;
+
+    char path[4096];
+    ssize_t n = readlink("/proc/self/exe", path, sizeof(path) - sizeof(BOX64CTL_LIBNAME) - 1);
+    if (n <= 0)
+        return NULL;
+    path[n] = '\0';
+    char *slash = strrchr(path, '/');
+    if (!slash)
+        return NULL;
+    strcpy(slash + 1, BOX64CTL_LIBNAME);
+    return dlopen(path, RTLD_NOW);
+}
+
+static inline box64ctl_api_t *box64ctl_api(void)
+{
+    static box64ctl_api_t api;
+    if (!api.loaded) {
+        api.loaded = 1;
+        void *h = box64ctl_dlopen();
+        if (h) {
+            *(void **)&api.stats = dlsym(h, "box64_stats");
+            *(void **)&api.purge = dlsym(h, "box64_purge");
+            *(void **)&api.block_info = dlsym(h, "box64_block_info");
+            *(void **)&api.compact = dlsym(h, "box64_compact");
+        }
+    }
+    return &api;
+}
+
+/* 1 when a box64 that implements the API answers (probes box64_stats) */
+static inline int box64ctl_available(void)
+{
+    box64ctl_stats_t s;
+    box64ctl_api_t *api = box64ctl_api();
+    return api->stats && api->stats(&s) == 0;
+}
+
+static inline int box64ctl_stats(box64ctl_stats_t *s)
+{
+    box64ctl_api_t *api = box64ctl_api();
+    memset(s, 0, sizeof(*s));
+    return api->stats ? api->stats(s) : -1;
+}
+
+static inline int box64ctl_purge(void)
+{
+    box64ctl_api_t *api = box64ctl_api();
+    return api->purge ? api->purge() : -1;
+}
+
+static inline int box64ctl_block_info(const void *addr, box64ctl_block_t *b)
+{
+    box64ctl_api_t *api = box64ctl_api();
+    memset(b, 0, sizeof(*b));
+    return api->block_info ? api->block_info(addr, b) : -1;
+}
+
+static inline int box64ctl_compact(void)
+{
+    box64ctl_api_t *api = box64ctl_api();
+    return api->compact ? api->compact() : -1;
+}
+
+#endif /* BOX64CTL_H */
@@ -0,0 +1,38 @@
+/*
+ * libbox64ctl.so - native-run stub of the box64 introspection API
+ *
+ * box64 with patches/box64ctl_wrapped_lib.patch replaces this library by
+ * its own wrapped libbox64ctl.so, so none of this runs under it. Anywhere
+ * else every call reports "no emulator" with -1 / ENOSYS.
+ */
+
+#include <errno.h>
+
+#include "../box64ctl.h"
+
+int box64_stats(box64ctl_stats_t *s)
+{
+    (void)s;
+    errno = ENOSYS;
+    return -1;
+}
+
+int box64_purge(void)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int box64_block_info(const void *addr, box64ctl_block_t *b)
+{
+    (void)addr;
+    (void)b;
+    errno = ENOSYS;
+    return -1;
+}
+
+int box64_compact(void)
+{
+    errno = ENOSYS;
+    return -1;
+}
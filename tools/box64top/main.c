@@ -0,0 +1,387 @@
+/*
+ * box64top
+ *
+ * Tool: live per-process view of running box64 processes
+ *
+ * Background:
+ *   Long-running box64 processes can't be sent SIGUSR2 and have a stats
+ *   file parsed every few seconds. With patches/box64top_shm_stats.patch
+ *   and BOX64_SHM_STATS=1, each box64 process keeps a box64_shm_stats_t
+ *   (common/box64_shm_stats.h) up to date at /dev/shm/box64-<pid>.
+ *   box64top maps those segments read-only and turns counters into
+ *   per-second rates; it never signals or stops the process.
+ *
+ * What it shows, per process:
+ *   - from /proc/<pid> (any box64, patched or not): CPU%, RSS, threads,
+ *     minor faults per second
+ *   - from the segment, when present: dynablocks, net blocks/s, code
+ *     KiB, hot-page blocks, forks, and the rates of the event
+ *     counters this box64 fills in (compiles, purges, SMC faults, bridge
+ *     calls, syscalls). Fields the running box64 does not fill show "-".
+ *
+ *   Processes are found from /dev/shm/box64-* and from /proc/<pid>/exe
+ *   pointing at a binary named box64.
+ *
+ * Run (native, on the box64 host):
+ *   ./box64top [-d secs] [-n count] [-p pid] [-b]
+ *
+ *   -d  refresh interval (default 1)
+ *   -n  stop after count refreshes (default: run until interrupted)
+ *   -p  only show this pid
+ *   -b  batch mode: no screen clearing, one block per refresh
+ *
+ * Load generators: any 5xx benchmark, e.g.
+ *   BOX64_SHM_STATS=1 BOX64_DYNAREC=1 box64 ./bin/501_thread_create_join &
+ *   ./box64top
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "../../common/box64_shm_stats.h"
+
+/* Configuration */
+#define MAX_PROCS         256
+#define DEFAULT_INTERVAL  1.0
+
+typedef struct {
+    uint64_t cpu_ticks;     /* utime + stime */
+    uint64_t minflt;
+    long threads;
+    long rss_pages;
+    box64_shm_stats_t shm;  /* copy taken at sample time */
+    int has_shm;
+} sample_t;
+
+typedef struct {
+    pid_t pid;
+    int seen;               /* found in this refresh */
+    long samples;
+    int has_prev;           /* prev holds an earlier sample */
+    char name[64];
+    sample_t cur, prev;
+    const box64_shm_stats_t *map;
+} proc_t;
+
+static proc_t procs[MAX_PROCS];
+static int nprocs = 0;
+
+static volatile sig_atomic_t stop = 0;
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void on_sigint(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+/* ── Discovery ───────────────────────────────────────────────────── */
+
+static proc_t *find_proc(pid_t pid, int create)
+{
+    for (int i = 0; i < nprocs; i++)
+        if (procs[i].pid == pid)
+            return &procs[i];
+    if (!create || nprocs == MAX_PROCS)
+        return NULL;
+    proc_t *p = &procs[nprocs++];
+    memset(p, 0, sizeof(*p));
+    p->pid = pid;
+    return p;
+}
+
+static void unmap_proc(proc_t *p)
+{
+    if (p->map)
+        munmap((void *)p->map, sizeof(box64_shm_stats_t));
+    p->map = NULL;
+}
+
+/* Map /dev/shm/box64-<pid> read-only; stays NULL until box64 set the magic */
+static void map_segment(proc_t *p)
+{
+    char name[64];
+    snprintf(name, sizeof(name), BOX64_SHM_PREFIX "%d", (int)p->pid);
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return;
+    void *m = mmap(NULL, sizeof(box64_shm_stats_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED)
+        return;
+    const box64_shm_stats_t *s = m;
+    if (__atomic_load_n(&s->magic, __ATOMIC_ACQUIRE) != BOX64_SHM_MAGIC ||
+        s->version != BOX64_SHM_VERSION || (pid_t)s->pid != p->pid) {
+        munmap(m, sizeof(box64_shm_stats_t));
+        return;
+    }
+    p->map = s;
+}
+
+static int is_box64_exe(pid_t pid)
+{
+    char path[64], exe[4096];
+    snprintf(path, sizeof(path), "/proc/%d/exe", (int)pid);
+    ssize_t n = readlink(path, exe, sizeof(exe) - 1);
+    if (n <= 0)
+        return 0;
+    exe[n] = '\0';
+    const char *base = strrchr(exe, '/');
+    return strcmp(base ? base + 1 : exe, "box64") == 0;
+}
+
+static void scan(pid_t only_pid)
+{
+    for (int i = 0; i < nprocs; i++)
+        procs[i].seen = 0;
+
+    DIR *d = opendir("/dev/shm");
+    struct dirent *e;
+    while (d && (e = readdir(d)) != NULL) {
+        if (strncmp(e->d_name, BOX64_SHM_PREFIX + 1, strlen(BOX64_SHM_PREFIX) - 1) != 0)
+            continue;
+        pid_t pid = atoi(e->d_name + strlen(BOX64_SHM_PREFIX) - 1);
+        if (pid <= 0 || (only_pid && pid != only_pid) || kill(pid, 0) != 0)
+            continue;   /* stale segment from a crashed process */
+        proc_t *p = find_proc(pid, 1);
+        if (p)
+            p->seen = 1;
+    }
+    if (d)
+        closedir(d);
+
+    d = opendir("/proc");
+    while (d && (e = readdir(d)) != NULL) {
+        pid_t pid = atoi(e->d_name);
+        if (pid <= 0 || (only_pid && pid != only_pid) || !is_box64_exe(pid))
+            continue;
+        proc_t *p = find_proc(pid, 1);
+        if (p)
+            p->seen = 1;
+    }
+    if (d)
+        closedir(d);
+
+    /* Drop processes that went away */
+    for (int i = 0; i < nprocs; ) {
+        if (procs[i].seen) {
+            i++;
+            continue;
+        }
+        unmap_proc(&procs[i]);
+        procs[i] = procs[--nprocs];
+    }
+}
+
+/* ── Sampling ────────────────────────────────────────────────────── */
+
+static int read_proc_stat(proc_t *p, sample_t *s)
+{
+    char path[64], buf[4096];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)p->pid);
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return -1;
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+
+    /* comm may contain spaces: parse from the last ')' (field 2) */
+    char *rp = strrchr(buf, ')');
+    if (!rp)
+        return -1;
+    unsigned long minflt, utime, stime;
+    long threads, rss;
+    if (sscanf(rp + 2,
+               "%*c %*d %*d %*d %*d %*d %*u %lu %*u %*u %*u %lu %lu "
+               "%*d %*d %*d %*d %ld %*d %*u %*u %ld",
+               &minflt, &utime, &stime, &threads, &rss) != 5)
+        return -1;
+    s->minflt = minflt;
+    s->cpu_ticks = utime + stime;
+    s->threads = threads;
+    s->rss_pages = rss;
+    return 0;
+}
+
+/* Program name: segment name, else argv[1] of "box64 prog ...", else comm */
+static void read_name(proc_t *p)
+{
+    if (p->map && p->map->name[0]) {
+        snprintf(p->name, sizeof(p->name), "%.63s", p->map->name);
+        return;
+    }
+    char path[64], buf[4096];
+    snprintf(path, sizeof(path), "/proc/%d/cmdline", (int)p->pid);
+    FILE *f = fopen(path, "r");
+    size_t n = f ? fread(buf, 1, sizeof(buf) - 1, f) : 0;
+    if (f)
+        fclose(f);
+    buf[n] = '\0';
+    size_t a0 = strlen(buf);
+    const char *arg = a0 + 1 < n ? buf + a0 + 1 : buf;
+    const char *base = strrchr(arg, '/');
+    snprintf(p->name, sizeof(p->name), "%s", base ? base + 1 : arg);
+}
+
+static void sample(proc_t *p)
+{
+    p->prev = p->cur;
+    p->has_prev = p->samples++ > 0;
+    memset(&p->cur, 0, sizeof(p->cur));
+
+    if (!p->map)
+        map_segment(p);
+    if (p->map) {
+        /* Plain copy: every field is a naturally aligned 64-bit store */
+        memcpy(&p->cur.shm, p->map, sizeof(box64_shm_stats_t));
+        p->cur.has_shm = 1;
+    }
+    if (!p->name[0] || p->map)
+        read_name(p);
+    read_proc_stat(p, &p->cur);
+}
+
+/* ── Display ─────────────────────────────────────────────────────── */
+
+static void put_rate(int valid, uint64_t cur, uint64_t prev, int has_prev, double secs)
+{
+    if (!valid)
+        printf(" %8s", "-");
+    else if (!has_prev)
+        printf(" %8s", "...");
+    else
+        printf(" %8.0f", (double)(cur - prev) / secs);
+}
+
+static void put_count(int valid, uint64_t v)
+{
+    if (valid)
+        printf(" %8llu", (unsigned long long)v);
+    else
+        printf(" %8s", "-");
+}
+
+static void display(double secs, int batch, long page_kb, long ticks)
+{
+    char tbuf[32];
+    time_t t = time(NULL);
+    strftime(tbuf, sizeof(tbuf), "%H:%M:%S", localtime(&t));
+
+    if (!batch)
+        printf("\033[H\033[2J");
+    printf("box64top - %s - %d process%s, refresh %.1fs\n\n",
+           tbuf, nprocs, nprocs == 1 ? "" : "es", secs);
+    printf("%7s %-16s %6s %8s %5s %8s | %8s %8s %8s %8s %8s | %8s %8s %8s %8s %8s %8s\n",
+           "PID", "NAME", "CPU%", "RSS_MiB", "THR", "MINFLT/s",
+           "BLOCKS", "BLK/s", "CODE_KiB", "HOTPAGE", "FORKS",
+           "COMP/s", "CMPms/s", "PURGE/s", "SMC/s", "BRIDGE/s", "SYSC/s");
+
+    for (int i = 0; i < nprocs; i++) {
+        proc_t *p = &procs[i];
+        sample_t *c = &p->cur, *o = &p->prev;
+        const box64_shm_stats_t *s = &c->shm, *ps = &o->shm;
+        uint64_t v = c->has_shm ? s->valid : 0;
+        int hp = p->has_prev && o->has_shm == c->has_shm;
+
+        printf("%7d %-16.16s", (int)p->pid, p->name);
+        if (p->has_prev)
+            printf(" %6.1f", (double)(c->cpu_ticks - o->cpu_ticks) / ticks / secs * 100.0);
+        else
+            printf(" %6s", "...");
+        printf(" %8.1f %5ld", c->rss_pages * page_kb / 1024.0, c->threads);
+        put_rate(1, c->minflt, o->minflt, p->has_prev, secs);
+        printf(" |");
+
+        int blk = (v & BOX64_SHM_F_BLOCKS) != 0;
+        put_count(blk, s->blocks);
+        if (blk && hp)
+            printf(" %8.0f", ((double)s->blocks - (double)ps->blocks) / secs);
+        else
+            printf(" %8s", blk ? "..." : "-");
+        put_count(blk, s->code_bytes / 1024);
+        put_count(blk, s->hot_page_blocks);
+        put_count(v & BOX64_SHM_F_FORKS, s->forks);
+        printf(" |");
+
+        int comp = (v & BOX64_SHM_F_COMPILED) != 0;
+        put_rate(comp, s->blocks_compiled, ps->blocks_compiled, hp, secs);
+        if (comp && hp)
+            printf(" %8.1f", (double)(s->compile_ns - ps->compile_ns) / 1e6 / secs);
+        else
+            printf(" %8s", comp ? "..." : "-");
+        put_rate(v & BOX64_SHM_F_PURGES, s->purges, ps->purges, hp, secs);
+        put_rate(v & BOX64_SHM_F_SMC, s->smc_faults, ps->smc_faults, hp, secs);
+        put_rate(v & BOX64_SHM_F_BRIDGE, s->bridge_calls, ps->bridge_calls, hp, secs);
+        put_rate(v & BOX64_SHM_F_SYSCALLS, s->syscalls, ps->syscalls, hp, secs);
+        printf("\n");
+    }
+    if (nprocs == 0)
+        printf("  (no box64 process found)\n");
+    if (batch)
+        printf("\n");
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    double interval = DEFAULT_INTERVAL;
+    long count = -1;
+    pid_t only_pid = 0;
+    int batch = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:n:p:bh")) != -1) {
+        switch (opt) {
+        case 'd': interval = atof(optarg); break;
+        case 'n': count = atol(optarg); break;
+        case 'p': only_pid = atoi(optarg); break;
+        case 'b': batch = 1; break;
+        default:
+            fprintf(stderr, "usage: %s [-d secs] [-n count] [-p pid] [-b]\n", argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (interval < 0.1)
+        interval = 0.1;
+
+    signal(SIGINT, on_sigint);
+    signal(SIGTERM, on_sigint);
+
+    long page_kb = sysconf(_SC_PAGESIZE) / 1024;
+    long ticks = sysconf(_SC_CLK_TCK);
+    struct timespec ts = { (time_t)interval,
+                           (long)((interval - (time_t)interval) * 1e9) };
+
+    uint64_t last = now_ns();
+    for (long n = 0; !stop && (count < 0 || n < count); n++) {
+        scan(only_pid);
+        for (int i = 0; i < nprocs; i++)
+            sample(&procs[i]);
+        uint64_t t = now_ns();
+        double secs = n ? (t - last) / 1e9 : interval;
+        last = t;
+        display(secs, batch, page_kb, ticks);
+        if (count < 0 || n + 1 < count)
+            nanosleep(&ts, NULL);
+    }
+
+    for (int i = 0; i < nprocs; i++)
+        unmap_proc(&procs[i]);
+    return 0;
+}
@@ -0,0 +1,236 @@
+/*
+ * box64trace
+ *
+ * Tool: decode box64 dynarec event traces into Chrome trace JSON
+ *
+ * Background:
+ *   With patches/dynarec_trace_ring.patch and BOX64_DYNAREC_TRACE_RING set,
+ *   every box64 process writes its per-thread event rings to a binary
+ *   file at exit (format: common/box64_trace.h). box64trace merges one
+ *   or more of those files - e.g. a parent and its forked children -
+ *   into a single JSON file for chrome://tracing or ui.perfetto.dev.
+ *
+ * Mapping:
+ *   COMPILE_START / COMPILE_END   B / E slice "compile" on the thread
+ *   FORK, MAP_ADD, MAP_DEL,       instant events
+ *   LINK, INVALIDATE, PURGE
+ *
+ *   Timestamps are CLOCK_MONOTONIC, shown relative to the earliest
+ *   start_ns over all input files. A per-file summary (events per type,
+ *   events dropped by full rings) goes to stderr.
+ *
+ * Run (native, on any host):
+ *   ./box64trace [-o trace.json] box64_trace.*.bin
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "../../common/box64_trace.h"
+
+/* Configuration */
+#define MAX_FILES  256
+
+typedef struct {
+    const char *path;
+    box64_trace_header_t hdr;
+    FILE *f;
+} input_t;
+
+static const char *type_names[BOX64_TRACE_NTYPES] = {
+    [BOX64_TRACE_COMPILE_START] = "compile",
+    [BOX64_TRACE_COMPILE_END]   = "compile",
+    [BOX64_TRACE_LINK]          = "link",
+    [BOX64_TRACE_INVALIDATE]    = "invalidate",
+    [BOX64_TRACE_PURGE]         = "purge",
+    [BOX64_TRACE_FORK]          = "fork",
+    [BOX64_TRACE_MAP_ADD]       = "mapping add",
+    [BOX64_TRACE_MAP_DEL]       = "mapping del",
+};
+
+static FILE *out;
+static int first_event = 1;
+
+/* ── JSON output ─────────────────────────────────────────────────── */
+
+static void begin_event(void)
+{
+    fprintf(out, first_event ? "\n  " : ",\n  ");
+    first_event = 0;
+}
+
+static void emit_metadata(uint32_t pid, uint32_t tid, const char *what, const char *name)
+{
+    begin_event();
+    fprintf(out, "{\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"name\":\"%s\","
+            "\"args\":{\"name\":\"%s\"}}", pid, tid, what, name);
+}
+
+static void emit_event(uint32_t pid, uint32_t tid, double ts_us,
+                       const box64_trace_event_t *e)
+{
+    const char *name = type_names[e->type];
+
+    begin_event();
+    switch (e->type) {
+    case BOX64_TRACE_COMPILE_START:
+        fprintf(out, "{\"ph\":\"B\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"name\":\"%s\","
+                "\"args\":{\"x86\":\"0x%llx\"}}",
+                pid, tid, ts_us, name, (unsigned long long)e->addr);
+        break;
+    case BOX64_TRACE_COMPILE_END:
+        fprintf(out, "{\"ph\":\"E\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"name\":\"%s\","
+                "\"args\":{\"x86_size\":%u,\"native_size\":%u}}",
+                pid, tid, ts_us, name, e->size, e->extra);
+        break;
+    case BOX64_TRACE_FORK:
+        fprintf(out, "{\"ph\":\"i\",\"s\":\"p\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,"
+                "\"name\":\"%s\",\"args\":{\"parent\":%llu}}",
+                pid, tid, ts_us, name, (unsigned long long)e->addr);
+        break;
+    case BOX64_TRACE_MAP_ADD:
+    case BOX64_TRACE_MAP_DEL:
+        fprintf(out, "{\"ph\":\"i\",\"s\":\"p\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,"
+                "\"name\":\"%s\",\"args\":{\"mmaplist\":\"0x%llx\",\"chunks\":%u}}",
+                pid, tid, ts_us, name, (unsigned long long)e->addr, e->size);
+        break;
+    case BOX64_TRACE_INVALIDATE:
+        fprintf(out, "{\"ph\":\"i\",\"s\":\"t\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,"
+                "\"name\":\"%s\",\"args\":{\"x86\":\"0x%llx\",\"x86_size\":%u,"
+                "\"destroy\":%u}}",
+                pid, tid, ts_us, name, (unsigned long long)e->addr, e->size, e->extra);
+        break;
+    default:
+        fprintf(out, "{\"ph\":\"i\",\"s\":\"t\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,"
+                "\"name\":\"%s\",\"args\":{\"x86\":\"0x%llx\",\"x86_size\":%u,"
+                "\"native_size\":%u}}",
+                pid, tid, ts_us, name, (unsigned long long)e->addr, e->size, e->extra);
+        break;
+    }
+}
+
+/* ── Decoding ────────────────────────────────────────────────────── */
+
+static int open_input(input_t *in, const char *path)
+{
+    in->path = path;
+    in->f = fopen(path, "rb");
+    if (!in->f) {
+        perror(path);
+        return -1;
+    }
+    if (fread(&in->hdr, sizeof(in->hdr), 1, in->f) != 1 ||
+        in->hdr.magic != BOX64_TRACE_MAGIC) {
+        fprintf(stderr, "%s: not a box64 trace\n", path);
+        fclose(in->f);
+        return -1;
+    }
+    if (in->hdr.version != BOX64_TRACE_VERSION) {
+        fprintf(stderr, "%s: trace version %u, expected %u\n",
+                path, in->hdr.version, BOX64_TRACE_VERSION);
+        fclose(in->f);
+        return -1;
+    }
+    return 0;
+}
+
+/* Write all events of one file, thread after thread. */
+static int decode(input_t *in, uint64_t t0)
+{
+    uint32_t pid = in->hdr.pid;
+    long per_type[BOX64_TRACE_NTYPES] = { 0 };
+    uint64_t dropped = 0, total = 0;
+    char name[64];
+
+    snprintf(name, sizeof(name), "box64 pid %u", pid);
+    emit_metadata(pid, 0, "process_name", name);
+
+    for (uint32_t t = 0; t < in->hdr.nthreads; t++) {
+        box64_trace_thread_t th;
+        if (fread(&th, sizeof(th), 1, in->f) != 1) {
+            fprintf(stderr, "%s: truncated at thread %u\n", in->path, t);
+            return -1;
+        }
+        snprintf(name, sizeof(name), "tid %u", th.tid);
+        emit_metadata(pid, th.tid, "thread_name", name);
+        dropped += th.dropped;
+
+        for (uint32_t i = 0; i < th.count; i++) {
+            box64_trace_event_t e;
+            if (fread(&e, sizeof(e), 1, in->f) != 1) {
+                fprintf(stderr, "%s: truncated in tid %u\n", in->path, th.tid);
+                return -1;
+            }
+            if (e.type == 0 || e.type >= BOX64_TRACE_NTYPES)
+                continue;
+            double ts_us = (e.ts_ns - t0) / 1000.0;
+            per_type[e.type]++;
+            total++;
+            emit_event(pid, th.tid, ts_us, &e);
+        }
+    }
+
+    fprintf(stderr, "%s: pid %u, %u threads, %llu events, %llu dropped\n",
+            in->path, pid, in->hdr.nthreads, (unsigned long long)total,
+            (unsigned long long)dropped);
+    for (int ty = 1; ty < BOX64_TRACE_NTYPES; ty++)
+        if (per_type[ty])
+            fprintf(stderr, "  %-16s %8ld\n",
+                    ty == BOX64_TRACE_COMPILE_START ? "compile start" :
+                    ty == BOX64_TRACE_COMPILE_END ? "compile end" : type_names[ty],
+                    per_type[ty]);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    static input_t inputs[MAX_FILES];
+    const char *out_path = NULL;
+    int ninputs = 0, opt, failed = 0;
+
+    while ((opt = getopt(argc, argv, "o:h")) != -1) {
+        switch (opt) {
+        case 'o': out_path = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-o trace.json] box64_trace.bin ...\n", argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind == argc) {
+        fprintf(stderr, "usage: %s [-o trace.json] box64_trace.bin ...\n", argv[0]);
+        return 1;
+    }
+
+    for (int i = optind; i < argc && ninputs < MAX_FILES; i++)
+        if (open_input(&inputs[ninputs], argv[i]) == 0)
+            ninputs++;
+        else
+            failed = 1;
+    if (ninputs == 0)
+        return 1;
+
+    uint64_t t0 = inputs[0].hdr.start_ns;
+    for (int i = 1; i < ninputs; i++)
+        if (inputs[i].hdr.start_ns < t0)
+            t0 = inputs[i].hdr.start_ns;
+
+    out = out_path ? fopen(out_path, "w") : stdout;
+    if (!out) {
+        perror(out_path);
+        return 1;
+    }
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (int i = 0; i < ninputs; i++) {
+        if (decode(&inputs[i], t0) != 0)
+            failed = 1;
+        fclose(inputs[i].f);
+    }
+    fprintf(out, "\n]}\n");
+    if (out != stdout)
+        fclose(out);
+    return failed;
+}